@@ -0,0 +1,524 @@
+#include "benchmark.h"
+#include "lzkn64.h"
+#include "compare.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char *benchmark_mode_names[BENCHMARK_MODE_COUNT] = {
+    "accurate",
+    "efficient",
+    "optimal",
+    "decompress"
+};
+
+static double get_time(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return (double)time.tv_sec + (double)time.tv_nsec / 1000000000.0;
+}
+
+static u32 read_u32_be(const u8 *buffer) {
+    return ((u32)buffer[0] << 24) | ((u32)buffer[1] << 16) | ((u32)buffer[2] << 8) | (u32)buffer[3];
+}
+
+static u8 *read_file(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    // Allocate at least one byte so an empty file still gets a buffer.
+    u8 *buffer = malloc(*size > 0 ? *size : 1);
+    if (buffer != NULL && fread(buffer, 1, *size, file) != *size) {
+        free(buffer);
+        buffer = NULL;
+    }
+
+    fclose(file);
+
+    return buffer;
+}
+
+static double get_megabytes_per_second(size_t size, double seconds) {
+    return seconds > 0.0 ? ((double)size / 1000000.0) / seconds : 0.0;
+}
+
+bool parse_arguments(int argc, const char *argv[], struct BenchmarkArguments *arguments) {
+    arguments->files = calloc(argc, sizeof(const char *));
+    if (arguments->files == NULL) {
+        return false;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0 && (i + 1) < argc) {
+            arguments->rom_file = argv[++i];
+        } else if (strcmp(argv[i], "-a") == 0 && (i + 1) < argc) {
+            arguments->file_address_table_rom_address = strtol(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-l") == 0 && (i + 1) < argc) {
+            arguments->list_file = argv[++i];
+        } else if (strcmp(argv[i], "-o") == 0 && (i + 1) < argc) {
+            arguments->output_file = argv[++i];
+        } else if (strcmp(argv[i], "-b") == 0 && (i + 1) < argc) {
+            arguments->baseline_file = argv[++i];
+        } else if (strcmp(argv[i], "-t") == 0 && (i + 1) < argc) {
+            arguments->threshold = strtod(argv[++i], NULL);
+        } else if (strcmp(argv[i], "-m") == 0 && (i + 1) < argc) {
+            // Comma separated list of the modes to run, e.g. "accurate,decompress".
+            const char *modes = argv[++i];
+
+            for (size_t mode = 0; mode < BENCHMARK_MODE_COUNT; mode++) {
+                size_t name_length = strlen(benchmark_mode_names[mode]);
+                const char *position = strstr(modes, benchmark_mode_names[mode]);
+
+                arguments->is_mode_enabled[mode] = position != NULL && (position[name_length] == ',' || position[name_length] == '\0');
+            }
+        } else if (strcmp(argv[i], "-k") == 0 && (i + 1) < argc) {
+            arguments->compare_name = argv[++i];
+        } else if (argv[i][0] == '-') {
+            return false;
+        } else {
+            arguments->files[arguments->file_count++] = argv[i];
+        }
+    }
+
+    if (arguments->rom_file != NULL && arguments->file_address_table_rom_address == 0) {
+        printf("Error: The offset of the file address table is needed to read the files of a ROM.\n");
+        return false;
+    }
+
+    return arguments->rom_file != NULL || arguments->list_file != NULL || arguments->file_count > 0;
+}
+
+void print_help(void) {
+    printf("Usage: lzkn64_benchmark [-r <ROM file> -a <File address table offset>] [-l <File list>] [-o <JSON report>] [-b <Baseline JSON report>] [-t <Threshold>] [-m <Modes>] [-k <Compare functions>] [<Files>...]\n");
+    printf("Runs every file through the LZKN64 compressors and the decompressor and reports the throughput as JSON.\n");
+    printf("\n");
+    printf("  -r  Use every compressed file of the ROM, accurate compression has to give the same bytes as the ROM.\n");
+    printf("  -a  Specifies the file address table offset in the ROM.\n");
+    printf("  -l  Use every uncompressed file listed in this file, one path per line.\n");
+    printf("  -o  Write the JSON report to this file instead of stdout.\n");
+    printf("  -b  Fail if any mode is slower than in this earlier JSON report by more than the threshold.\n");
+    printf("  -t  Threshold in percent (default: 10).\n");
+    printf("  -m  Comma separated list of modes: accurate, efficient, optimal, decompress (default: all of them).\n");
+    printf("  -k  Compare functions used by the compressors: scalar, sse2, avx2 (default: the fastest the CPU supports).\n");
+    printf("      A report made with -k scalar as the baseline shows how much faster the vector ones are.\n");
+}
+
+static bool add_file(struct BenchmarkFile **files, size_t *file_count, size_t *file_capacity, struct BenchmarkFile *file) {
+    if (*file_count == *file_capacity) {
+        size_t new_capacity = *file_capacity > 0 ? *file_capacity * 2 : 256;
+        struct BenchmarkFile *new_files = realloc(*files, new_capacity * sizeof(struct BenchmarkFile));
+        if (new_files == NULL) {
+            return false;
+        }
+
+        *files = new_files;
+        *file_capacity = new_capacity;
+    }
+
+    (*files)[(*file_count)++] = *file;
+
+    return true;
+}
+
+static bool add_uncompressed_file(struct BenchmarkFile **files, size_t *file_count, size_t *file_capacity, const char *path) {
+    struct BenchmarkFile file;
+    memset(&file, 0, sizeof(file));
+
+    file.uncompressed_buffer = read_file(path, &file.uncompressed_size);
+    file.name = strdup(path);
+
+    if (file.uncompressed_buffer == NULL || file.name == NULL) {
+        printf("Error: Could not read %s.\n", path);
+        return false;
+    }
+
+    return add_file(files, file_count, file_capacity, &file);
+}
+
+// Every compressed file of the ROM is decompressed once up front, the compressed file is what accurate compression has to give.
+static bool add_rom_files(struct BenchmarkFile **files, size_t *file_count, size_t *file_capacity, const u8 *rom_buffer, size_t rom_size, u32 file_address_table_rom_address) {
+    for (size_t index = 0; file_address_table_rom_address + ((index + 2) * sizeof(u32)) <= rom_size; index++) {
+        u32 start_rom_address = read_u32_be(rom_buffer + file_address_table_rom_address + (index * sizeof(u32)));
+        u32 end_rom_address = read_u32_be(rom_buffer + file_address_table_rom_address + ((index + 1) * sizeof(u32)));
+
+        if (start_rom_address == 0 || end_rom_address == 0) {
+            // End of the table.
+            break;
+        }
+
+        bool is_compressed = start_rom_address >> 31;
+        start_rom_address &= 0x7FFFFFFF;
+        end_rom_address &= 0x7FFFFFFF;
+
+        if (end_rom_address < start_rom_address || end_rom_address > rom_size) {
+            printf("Error: File %zu of the ROM is invalid.\n", index);
+            return false;
+        }
+
+        if (!is_compressed || start_rom_address == end_rom_address) {
+            // Uncompressed files never go through LZKN64.
+            continue;
+        }
+
+        struct BenchmarkFile file;
+        memset(&file, 0, sizeof(file));
+        file.reference_buffer = rom_buffer + start_rom_address;
+        file.reference_size = end_rom_address - start_rom_address;
+
+        size_t input_consumed;
+        if (!lzkn64_decompressed_size(file.reference_buffer, file.reference_size, &file.uncompressed_size)
+            || (file.uncompressed_buffer = malloc(file.uncompressed_size > 0 ? file.uncompressed_size : 1)) == NULL
+            || !lzkn64_decompress_checked(file.reference_buffer, file.reference_size, file.uncompressed_buffer, file.uncompressed_size, &input_consumed, &file.uncompressed_size)) {
+            printf("Error: Could not decompress file %zu of the ROM.\n", index);
+            return false;
+        }
+
+        // Numbered like the files in the file address table, the same as in the reports of rommy -v and -x.
+        char name[64];
+        snprintf(name, sizeof(name), "rom:%zu", index);
+        file.name = strdup(name);
+
+        if (file.name == NULL || !add_file(files, file_count, file_capacity, &file)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static size_t compress(enum BenchmarkMode mode, const u8 *input_buffer, u8 *output_buffer, size_t input_size) {
+    if (mode == BENCHMARK_MODE_EFFICIENT) {
+        return lzkn64_compress_efficient(input_buffer, output_buffer, input_size);
+    } else if (mode == BENCHMARK_MODE_OPTIMAL) {
+        return lzkn64_compress_optimal(input_buffer, output_buffer, input_size);
+    }
+
+    return lzkn64_compress_accurate(input_buffer, output_buffer, input_size);
+}
+
+static bool is_decompressed_equal(const u8 *compressed_buffer, size_t compressed_size, const u8 *uncompressed_buffer, size_t uncompressed_size, u8 *scratch_buffer) {
+    size_t input_consumed;
+    size_t output_size;
+
+    return lzkn64_decompress_checked(compressed_buffer, compressed_size, scratch_buffer, uncompressed_size, &input_consumed, &output_size)
+        && output_size == uncompressed_size && memcmp(scratch_buffer, uncompressed_buffer, uncompressed_size) == 0;
+}
+
+// Compressed files are padded to a 2-byte boundary in the ROM.
+static bool is_reference_equal(const struct BenchmarkFile *file, u8 *compressed_buffer, size_t compressed_size) {
+    if (compressed_size & 1) {
+        compressed_buffer[compressed_size++] = 0;
+    }
+
+    return compressed_size == file->reference_size && memcmp(compressed_buffer, file->reference_buffer, compressed_size) == 0;
+}
+
+static void run_mode(enum BenchmarkMode mode, struct BenchmarkFile *files, size_t file_count, u8 *compressed_buffer, u8 *scratch_buffer, struct BenchmarkResult *result) {
+    for (size_t index = 0; index < file_count; index++) {
+        struct BenchmarkFile *file = &files[index];
+
+        if (mode == BENCHMARK_MODE_DECOMPRESS) {
+            // Files from the ROM are decompressed from the ROM, the others from their accurate compression.
+            const u8 *input_buffer = file->reference_buffer;
+            size_t input_size = file->reference_size;
+
+            if (input_buffer == NULL) {
+                input_size = lzkn64_compress_accurate(file->uncompressed_buffer, compressed_buffer, file->uncompressed_size);
+                input_buffer = compressed_buffer;
+            }
+
+            size_t input_consumed;
+            size_t output_size;
+            double start_time = get_time();
+            bool is_valid = lzkn64_decompress_checked(input_buffer, input_size, scratch_buffer, file->uncompressed_size, &input_consumed, &output_size);
+            file->seconds[mode] = get_time() - start_time;
+            file->compressed_size[mode] = input_size;
+
+            if (!is_valid || output_size != file->uncompressed_size || memcmp(scratch_buffer, file->uncompressed_buffer, output_size) != 0) {
+                result->mismatch_count++;
+                fprintf(stderr, "%s: %s doesn't give the original file.\n", file->name, benchmark_mode_names[mode]);
+            }
+        } else {
+            double start_time = get_time();
+            size_t compressed_size = compress(mode, file->uncompressed_buffer, compressed_buffer, file->uncompressed_size);
+            file->seconds[mode] = get_time() - start_time;
+            file->compressed_size[mode] = compressed_size;
+
+            if (!is_decompressed_equal(compressed_buffer, compressed_size, file->uncompressed_buffer, file->uncompressed_size, scratch_buffer)) {
+                result->mismatch_count++;
+                fprintf(stderr, "%s: %s compression doesn't decompress to the original file.\n", file->name, benchmark_mode_names[mode]);
+            } else if (mode == BENCHMARK_MODE_ACCURATE && file->reference_buffer != NULL && !is_reference_equal(file, compressed_buffer, compressed_size)) {
+                result->mismatch_count++;
+                fprintf(stderr, "%s: accurate compression doesn't match the ROM.\n", file->name);
+            }
+        }
+
+        result->seconds += file->seconds[mode];
+        result->uncompressed_size += file->uncompressed_size;
+        result->compressed_size += file->compressed_size[mode];
+    }
+}
+
+static enum BenchmarkMode outlier_sort_mode;
+
+static int compare_throughput(const void *a, const void *b) {
+    const struct BenchmarkFile *file_a = *(const struct BenchmarkFile * const *)a;
+    const struct BenchmarkFile *file_b = *(const struct BenchmarkFile * const *)b;
+    double throughput_a = get_megabytes_per_second(file_a->uncompressed_size, file_a->seconds[outlier_sort_mode]);
+    double throughput_b = get_megabytes_per_second(file_b->uncompressed_size, file_b->seconds[outlier_sort_mode]);
+
+    return (throughput_a > throughput_b) - (throughput_a < throughput_b);
+}
+
+// The slowest files of the mode, in MB of uncompressed data per second.
+static void write_outliers(FILE *output, enum BenchmarkMode mode, struct BenchmarkFile *files, size_t file_count, struct BenchmarkFile **sorted_files) {
+    size_t sorted_file_count = 0;
+    for (size_t index = 0; index < file_count; index++) {
+        if (files[index].uncompressed_size >= BENCHMARK_OUTLIER_MINIMUM_SIZE) {
+            sorted_files[sorted_file_count++] = &files[index];
+        }
+    }
+
+    outlier_sort_mode = mode;
+    qsort(sorted_files, sorted_file_count, sizeof(struct BenchmarkFile *), compare_throughput);
+
+    fprintf(output, "      \"outliers\": [");
+
+    for (size_t index = 0; index < sorted_file_count && index < BENCHMARK_OUTLIER_COUNT; index++) {
+        const struct BenchmarkFile *file = sorted_files[index];
+
+        fprintf(output, "%s\n        {\"name\": \"%s\", \"size\": %zu, \"compressed_size\": %zu, \"mb_per_s\": %.3f}", index > 0 ? "," : "", file->name, file->uncompressed_size, file->compressed_size[mode], get_megabytes_per_second(file->uncompressed_size, file->seconds[mode]));
+    }
+
+    fprintf(output, "%s]\n", sorted_file_count > 0 ? "\n      " : "");
+}
+
+static void write_report(FILE *output, struct BenchmarkFile *files, size_t file_count, const struct BenchmarkResult *results) {
+    struct BenchmarkFile **sorted_files = calloc(file_count > 0 ? file_count : 1, sizeof(struct BenchmarkFile *));
+
+    size_t uncompressed_size = 0;
+    for (size_t index = 0; index < file_count; index++) {
+        uncompressed_size += files[index].uncompressed_size;
+    }
+
+    fprintf(output, "{\n");
+    fprintf(output, "  \"files\": %zu,\n", file_count);
+    fprintf(output, "  \"bytes\": %zu,\n", uncompressed_size);
+    fprintf(output, "  \"compare\": \"%s\",\n", compare_get_name());
+    fprintf(output, "  \"modes\": {");
+
+    bool is_first_mode = true;
+    for (size_t mode = 0; mode < BENCHMARK_MODE_COUNT; mode++) {
+        const struct BenchmarkResult *result = &results[mode];
+        if (!result->is_enabled) {
+            continue;
+        }
+
+        fprintf(output, "%s\n    \"%s\": {\n", is_first_mode ? "" : ",", benchmark_mode_names[mode]);
+        fprintf(output, "      \"mb_per_s\": %.3f,\n", get_megabytes_per_second(result->uncompressed_size, result->seconds));
+        fprintf(output, "      \"seconds\": %.6f,\n", result->seconds);
+        fprintf(output, "      \"ratio\": %.6f,\n", result->uncompressed_size > 0 ? (double)result->compressed_size / (double)result->uncompressed_size : 0.0);
+        fprintf(output, "      \"mismatches\": %zu,\n", result->mismatch_count);
+
+        if (result->baseline_megabytes_per_second > 0.0) {
+            fprintf(output, "      \"baseline_mb_per_s\": %.3f,\n", result->baseline_megabytes_per_second);
+            fprintf(output, "      \"regression\": %s,\n", result->is_regression ? "true" : "false");
+        }
+
+        if (sorted_files != NULL) {
+            write_outliers(output, mode, files, file_count, sorted_files);
+        }
+
+        fprintf(output, "    }");
+        is_first_mode = false;
+    }
+
+    fprintf(output, "\n  }\n}\n");
+
+    free(sorted_files);
+}
+
+// Only reads reports this tool wrote itself, it doesn't parse JSON in general.
+static bool read_baseline(const char *path, struct BenchmarkResult *results, double threshold) {
+    size_t size;
+    u8 *buffer = read_file(path, &size);
+    if (buffer == NULL) {
+        return false;
+    }
+
+    char *report = malloc(size + 1);
+    if (report == NULL) {
+        free(buffer);
+        return false;
+    }
+
+    memcpy(report, buffer, size);
+    report[size] = '\0';
+    free(buffer);
+
+    for (size_t mode = 0; mode < BENCHMARK_MODE_COUNT; mode++) {
+        char key[64];
+        snprintf(key, sizeof(key), "\"%s\": {", benchmark_mode_names[mode]);
+
+        const char *position = strstr(report, key);
+        if (!results[mode].is_enabled || position == NULL || (position = strstr(position, "\"mb_per_s\":")) == NULL) {
+            continue;
+        }
+
+        double current_megabytes_per_second = get_megabytes_per_second(results[mode].uncompressed_size, results[mode].seconds);
+        results[mode].baseline_megabytes_per_second = strtod(position + strlen("\"mb_per_s\":"), NULL);
+        results[mode].is_regression = current_megabytes_per_second < results[mode].baseline_megabytes_per_second * (1.0 - (threshold / 100.0));
+    }
+
+    free(report);
+
+    return true;
+}
+
+int main(int argc, const char *argv[]) {
+    struct BenchmarkArguments arguments;
+    memset(&arguments, 0, sizeof(arguments));
+    arguments.threshold = BENCHMARK_DEFAULT_THRESHOLD;
+
+    for (size_t mode = 0; mode < BENCHMARK_MODE_COUNT; mode++) {
+        arguments.is_mode_enabled[mode] = true;
+    }
+
+    if (!parse_arguments(argc, argv, &arguments)) {
+        print_help();
+        return EXIT_FAILURE;
+    }
+
+    compare_initialize();
+
+    if (arguments.compare_name != NULL && !compare_use(arguments.compare_name)) {
+        printf("Error: The compare functions %s aren't supported.\n", arguments.compare_name);
+        return EXIT_FAILURE;
+    }
+
+    struct BenchmarkFile *files = NULL;
+    size_t file_count = 0;
+    size_t file_capacity = 0;
+
+    u8 *rom_buffer = NULL;
+    if (arguments.rom_file != NULL) {
+        size_t rom_size;
+        rom_buffer = read_file(arguments.rom_file, &rom_size);
+        if (rom_buffer == NULL) {
+            printf("Error: Could not read ROM file.\n");
+            return EXIT_FAILURE;
+        }
+
+        if (!add_rom_files(&files, &file_count, &file_capacity, rom_buffer, rom_size, arguments.file_address_table_rom_address)) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (arguments.list_file != NULL) {
+        FILE *list_file = fopen(arguments.list_file, "r");
+        if (list_file == NULL) {
+            printf("Error: Could not open file list.\n");
+            return EXIT_FAILURE;
+        }
+
+        char path[4096];
+        while (fgets(path, sizeof(path), list_file) != NULL) {
+            path[strcspn(path, "\r\n")] = '\0';
+
+            if (path[0] != '\0' && !add_uncompressed_file(&files, &file_count, &file_capacity, path)) {
+                return EXIT_FAILURE;
+            }
+        }
+
+        fclose(list_file);
+    }
+
+    for (size_t index = 0; index < arguments.file_count; index++) {
+        if (!add_uncompressed_file(&files, &file_count, &file_capacity, arguments.files[index])) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    size_t maximum_uncompressed_size = 0;
+    for (size_t index = 0; index < file_count; index++) {
+        if (files[index].uncompressed_size > maximum_uncompressed_size) {
+            maximum_uncompressed_size = files[index].uncompressed_size;
+        }
+    }
+
+    // Shared by all files, big enough for the biggest one.
+    u8 *compressed_buffer = malloc(LZKN64_COMPRESS_BOUND(maximum_uncompressed_size));
+    u8 *scratch_buffer = malloc(maximum_uncompressed_size > 0 ? maximum_uncompressed_size : 1);
+    if (compressed_buffer == NULL || scratch_buffer == NULL) {
+        printf("Error: Could not allocate memory for benchmark buffers.\n");
+        return EXIT_FAILURE;
+    }
+
+    struct BenchmarkResult results[BENCHMARK_MODE_COUNT];
+    memset(results, 0, sizeof(results));
+
+    for (size_t mode = 0; mode < BENCHMARK_MODE_COUNT; mode++) {
+        if (arguments.is_mode_enabled[mode]) {
+            results[mode].is_enabled = true;
+            run_mode(mode, files, file_count, compressed_buffer, scratch_buffer, &results[mode]);
+        }
+    }
+
+    if (arguments.baseline_file != NULL && !read_baseline(arguments.baseline_file, results, arguments.threshold)) {
+        printf("Error: Could not read baseline report.\n");
+        return EXIT_FAILURE;
+    }
+
+    FILE *output = stdout;
+    if (arguments.output_file != NULL && (output = fopen(arguments.output_file, "w")) == NULL) {
+        printf("Error: Could not open output file.\n");
+        return EXIT_FAILURE;
+    }
+
+    write_report(output, files, file_count, results);
+
+    if (output != stdout) {
+        fclose(output);
+    }
+
+    // With the report in a file, a short summary goes to stdout.
+    if (output != stdout) {
+        printf("compare    %s\n", compare_get_name());
+    }
+
+    bool is_failed = false;
+    for (size_t mode = 0; mode < BENCHMARK_MODE_COUNT; mode++) {
+        if (!results[mode].is_enabled) {
+            continue;
+        }
+
+        // With the report in a file, a short summary goes to stdout.
+        if (output != stdout) {
+            printf("%-10s %9.3f MB/s  ratio %.4f  %zu mismatches%s\n", benchmark_mode_names[mode], get_megabytes_per_second(results[mode].uncompressed_size, results[mode].seconds), results[mode].uncompressed_size > 0 ? (double)results[mode].compressed_size / (double)results[mode].uncompressed_size : 0.0, results[mode].mismatch_count, results[mode].is_regression ? "  REGRESSION" : "");
+        }
+
+        is_failed = is_failed || results[mode].mismatch_count > 0 || results[mode].is_regression;
+    }
+
+    for (size_t index = 0; index < file_count; index++) {
+        free(files[index].name);
+        free(files[index].uncompressed_buffer);
+    }
+
+    free(files);
+    free(arguments.files);
+    free(rom_buffer);
+    free(compressed_buffer);
+    free(scratch_buffer);
+
+    return is_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
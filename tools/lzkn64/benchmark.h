@@ -0,0 +1,54 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "types.h"
+
+#define BENCHMARK_DEFAULT_THRESHOLD 10.0 // Percent the throughput may drop compared to the baseline.
+#define BENCHMARK_OUTLIER_COUNT 10
+#define BENCHMARK_OUTLIER_MINIMUM_SIZE 0x400 // Smaller files are too fast to time reliably.
+
+enum BenchmarkMode {
+    BENCHMARK_MODE_ACCURATE,
+    BENCHMARK_MODE_EFFICIENT,
+    BENCHMARK_MODE_OPTIMAL,
+    BENCHMARK_MODE_DECOMPRESS,
+    BENCHMARK_MODE_COUNT
+};
+
+struct BenchmarkFile {
+    char *name;
+    u8 *uncompressed_buffer;
+    size_t uncompressed_size;
+    const u8 *reference_buffer; // The compressed file in the ROM, NULL for files that aren't from the ROM.
+    size_t reference_size;
+    double seconds[BENCHMARK_MODE_COUNT];
+    size_t compressed_size[BENCHMARK_MODE_COUNT];
+};
+
+struct BenchmarkResult {
+    bool is_enabled;
+    double seconds;
+    size_t uncompressed_size;
+    size_t compressed_size;
+    size_t mismatch_count; // Files that don't decompress to the input again, or that don't match the ROM in accurate mode.
+    bool is_regression;
+    double baseline_megabytes_per_second;
+};
+
+struct BenchmarkArguments {
+    const char *rom_file;
+    u32 file_address_table_rom_address;
+    const char *list_file;
+    const char *output_file;
+    const char *baseline_file;
+    double threshold;
+    bool is_mode_enabled[BENCHMARK_MODE_COUNT];
+    const char *compare_name; // NULL for the fastest compare functions the CPU supports.
+    const char **files;
+    size_t file_count;
+};
+
+bool parse_arguments(int argc, const char *argv[], struct BenchmarkArguments *arguments);
+void print_help(void);
+
+#endif // BENCHMARK_H
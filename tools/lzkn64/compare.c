@@ -0,0 +1,161 @@
+#include "compare.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define COMPARE_X86
+#include <immintrin.h>
+#endif
+
+typedef size_t (*MatchLengthFunction)(const u8 *buffer_a, const u8 *buffer_b, size_t maximum_length);
+typedef size_t (*RunLengthFunction)(const u8 *buffer, u8 value, size_t maximum_length);
+
+static size_t match_length_scalar(const u8 *buffer_a, const u8 *buffer_b, size_t maximum_length) {
+    size_t length = 0;
+
+    while (length < maximum_length && buffer_a[length] == buffer_b[length]) {
+        length++;
+    }
+
+    return length;
+}
+
+static size_t run_length_scalar(const u8 *buffer, u8 value, size_t maximum_length) {
+    size_t length = 0;
+
+    while (length < maximum_length && buffer[length] == value) {
+        length++;
+    }
+
+    return length;
+}
+
+#ifdef COMPARE_X86
+// The vector loops only load whole vectors that fit within the maximum length, the rest is compared one byte at a time.
+
+__attribute__((target("sse2")))
+static size_t match_length_sse2(const u8 *buffer_a, const u8 *buffer_b, size_t maximum_length) {
+    size_t length = 0;
+
+    while ((length + 16) <= maximum_length) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(buffer_a + length));
+        __m128i b = _mm_loadu_si128((const __m128i *)(buffer_b + length));
+        u32 mask = _mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+
+        if (mask != 0xFFFF) {
+            return length + __builtin_ctz(~mask);
+        }
+
+        length += 16;
+    }
+
+    return length + match_length_scalar(buffer_a + length, buffer_b + length, maximum_length - length);
+}
+
+__attribute__((target("sse2")))
+static size_t run_length_sse2(const u8 *buffer, u8 value, size_t maximum_length) {
+    __m128i values = _mm_set1_epi8(value);
+    size_t length = 0;
+
+    while ((length + 16) <= maximum_length) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(buffer + length));
+        u32 mask = _mm_movemask_epi8(_mm_cmpeq_epi8(a, values));
+
+        if (mask != 0xFFFF) {
+            return length + __builtin_ctz(~mask);
+        }
+
+        length += 16;
+    }
+
+    return length + run_length_scalar(buffer + length, value, maximum_length - length);
+}
+
+__attribute__((target("avx2")))
+static size_t run_length_avx2(const u8 *buffer, u8 value, size_t maximum_length) {
+    __m256i values = _mm256_set1_epi8(value);
+    size_t length = 0;
+
+    while ((length + 32) <= maximum_length) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(buffer + length));
+        u32 mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, values));
+
+        if (mask != 0xFFFFFFFF) {
+            return length + __builtin_ctz(~mask);
+        }
+
+        length += 32;
+    }
+
+    return length + run_length_sse2(buffer + length, value, maximum_length - length);
+}
+#endif
+
+static MatchLengthFunction match_length_function = match_length_scalar;
+static RunLengthFunction run_length_function = run_length_scalar;
+static const char *compare_name = "scalar";
+static pthread_once_t compare_once = PTHREAD_ONCE_INIT;
+
+static void compare_select(void) {
+#ifdef COMPARE_X86
+    __builtin_cpu_init();
+
+    // Matches are never longer than SLIDING_WINDOW_COPY_MAXIMUM_LENGTH, so only runs get long enough for 32 byte compares to pay off.
+    if (__builtin_cpu_supports("avx2")) {
+        match_length_function = match_length_sse2;
+        run_length_function = run_length_avx2;
+        compare_name = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        match_length_function = match_length_sse2;
+        run_length_function = run_length_sse2;
+        compare_name = "sse2";
+    }
+#endif
+}
+
+void compare_initialize(void) {
+    pthread_once(&compare_once, compare_select);
+}
+
+bool compare_use(const char *name) {
+    // Picks the fastest ones first, so a later compare_initialize doesn't replace them again.
+    compare_initialize();
+
+    if (strcmp(name, "scalar") == 0) {
+        match_length_function = match_length_scalar;
+        run_length_function = run_length_scalar;
+        compare_name = "scalar";
+        return true;
+    }
+
+#ifdef COMPARE_X86
+    if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2")) {
+        match_length_function = match_length_sse2;
+        run_length_function = run_length_sse2;
+        compare_name = "sse2";
+        return true;
+    }
+
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        match_length_function = match_length_sse2;
+        run_length_function = run_length_avx2;
+        compare_name = "avx2";
+        return true;
+    }
+#endif
+
+    return false;
+}
+
+size_t compare_match_length(const u8 *buffer_a, const u8 *buffer_b, size_t maximum_length) {
+    return match_length_function(buffer_a, buffer_b, maximum_length);
+}
+
+size_t compare_run_length(const u8 *buffer, u8 value, size_t maximum_length) {
+    return run_length_function(buffer, value, maximum_length);
+}
+
+const char *compare_get_name(void) {
+    return compare_name;
+}
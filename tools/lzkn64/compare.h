@@ -0,0 +1,22 @@
+#ifndef COMPARE_H
+#define COMPARE_H
+
+#include "types.h"
+
+// Picks the fastest compare functions the CPU supports. Has to be called before using any of the functions below.
+void compare_initialize(void);
+
+// Returns how many bytes at the start of both buffers are equal, up to the maximum length.
+size_t compare_match_length(const u8 *buffer_a, const u8 *buffer_b, size_t maximum_length);
+
+// Returns how many bytes at the start of the buffer are equal to the value, up to the maximum length.
+size_t compare_run_length(const u8 *buffer, u8 value, size_t maximum_length);
+
+// Uses the compare functions of that name ("scalar", "sse2" or "avx2") instead of the fastest ones.
+// Returns false if there are none of that name or the CPU doesn't support them.
+bool compare_use(const char *name);
+
+// Name of the compare functions that are used, e.g. "avx2".
+const char *compare_get_name(void);
+
+#endif // COMPARE_H
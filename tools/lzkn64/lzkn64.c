@@ -1,88 +1,342 @@
 #include "lzkn64.h"
+#include "compare.h"
 
 #include <byteswap.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MATCH_FINDER_HASH_BITS 15
+#define MATCH_FINDER_HASH_SIZE (1 << MATCH_FINDER_HASH_BITS)
+#define MATCH_FINDER_CHAIN_SIZE 0x400 // Has to be larger than the biggest sliding window, positions further back are never looked at.
+#define MATCH_FINDER_EMPTY 0xFFFFFFFF
+
+// Indexes every input position by its first bytes so the longest sliding window match can be found without trying every offset.
+// Positions of 3-byte sequences are kept in hash chains, 2-byte and 1-byte sequences only need their most recent position.
+typedef struct {
+    u32 hash_heads[MATCH_FINDER_HASH_SIZE];
+    u32 hash_chain[MATCH_FINDER_CHAIN_SIZE];
+    u32 pair_heads[0x10000];
+    u32 byte_heads[0x100];
+    size_t insert_offset;
+    size_t run_offset; // All bytes from here up to the run end offset have the same value.
+    size_t run_end_offset;
+} MatchFinder;
+
+// The best commands that could start at an input position, these only depend on the input data and not on the commands picked before.
+typedef struct {
+    u16 sliding_window_match_offset;
+    u16 sliding_window_match_length;
+    u16 rle_match_length;
+} PositionMatch;
+
+typedef void (*FindMatchFunction)(MatchFinder *match_finder, const u8 *input_buffer, size_t input_size, size_t input_offset, PositionMatch *match);
+
+typedef struct {
+    FindMatchFunction find_match;
+    const u8 *input_buffer;
+    size_t input_size;
+    size_t start_offset;
+    size_t end_offset;
+    PositionMatch *matches;
+    bool success;
+} FindMatchesTask;
+
+static MatchFinder *match_finder_create(void) {
+    MatchFinder *match_finder = malloc(sizeof(MatchFinder));
+    if (match_finder == NULL) {
+        return NULL;
+    }
 
-size_t lzkn64_compress_efficient(const u8 *input_buffer, u8 *output_buffer, size_t input_size) {
-    size_t input_offset = 0;
-    size_t output_offset = 4; // Skip the first 4 bytes since they are the compressed file size.
+    compare_initialize();
 
-    size_t input_last_processed_data_offset = 0;
+    // Setting every byte to 0xFF marks all entries as MATCH_FINDER_EMPTY.
+    memset(match_finder, 0xFF, sizeof(MatchFinder));
+    match_finder->insert_offset = 0;
+    match_finder->run_offset = 0;
+    match_finder->run_end_offset = 0;
 
-    while (input_offset < input_size) {
-        size_t sliding_window_copy_maximum_length = 0;
+    return match_finder;
+}
 
-        // Find the maximum length of the sliding window copy, e.g. how many bytes can be copied without going out of bounds.
-        if ((input_size - input_offset) >= SLIDING_WINDOW_COPY_MAXIMUM_LENGTH) {
-            sliding_window_copy_maximum_length = SLIDING_WINDOW_COPY_MAXIMUM_LENGTH;
-        } else {
-            sliding_window_copy_maximum_length = input_size - input_offset;
-        }
+static void match_finder_destroy(MatchFinder *match_finder) {
+    free(match_finder);
+}
 
-        size_t sliding_window_maximum_offset = 0;
+static inline u32 match_finder_hash(const u8 *buffer) {
+    u32 value = (buffer[0] << 16) | (buffer[1] << 8) | buffer[2];
 
-        // Find the maximum offset of the sliding window copy, e.g. how far back can we go to copy bytes.
-        if (input_offset >= SLIDING_WINDOW_SIZE_EFFICIENT) {
-            sliding_window_maximum_offset = SLIDING_WINDOW_SIZE_EFFICIENT;
-        } else {
-            sliding_window_maximum_offset = input_offset;
-        }
+    return (value * 0x9E3779B1) >> (32 - MATCH_FINDER_HASH_BITS);
+}
 
-        size_t rle_window_maximum_length = 0;
+// Index every position before the input offset that hasn't been indexed yet.
+static void match_finder_update(MatchFinder *match_finder, const u8 *input_buffer, size_t input_size, size_t input_offset) {
+    for (size_t i = match_finder->insert_offset; i < input_offset; i++) {
+        if ((i + 2) < input_size) {
+            u32 hash = match_finder_hash(input_buffer + i);
 
-        // Find the maximum length of the RLE window, e.g. how many bytes can be matched without going out of bounds.
-        if ((input_size - input_offset) >= RLE_LONG_MAXIMUM_LENGTH) {
-            rle_window_maximum_length = RLE_LONG_MAXIMUM_LENGTH;
-        } else {
-            rle_window_maximum_length = input_size - input_offset;
+            match_finder->hash_chain[i % MATCH_FINDER_CHAIN_SIZE] = match_finder->hash_heads[hash];
+            match_finder->hash_heads[hash] = i;
         }
 
-        size_t sliding_window_match_offset = 0;
-        size_t sliding_window_match_length = 0;
+        if ((i + 1) < input_size) {
+            match_finder->pair_heads[(input_buffer[i] << 8) | input_buffer[i + 1]] = i;
+        }
 
-        // Find the longest match in the sliding window.
-        for (size_t i = 1; i <= sliding_window_maximum_offset; i++) {
-            size_t match_length = 0;
+        match_finder->byte_heads[input_buffer[i]] = i;
+    }
 
-            for (size_t j = 0; j < sliding_window_copy_maximum_length; j++) {
-                if (input_buffer[input_offset - i + j] == input_buffer[input_offset + j]) {
-                    match_length++;
-                } else {
-                    break;
-                }
-            }
+    match_finder->insert_offset = input_offset;
+}
 
-            if (match_length > sliding_window_match_length) {
-                sliding_window_match_offset = i;
-                sliding_window_match_length = match_length;
-            }
-        }
+// Returns how many bytes starting at the input offset have the same value, runs are only scanned once.
+static size_t match_finder_run_length(MatchFinder *match_finder, const u8 *input_buffer, size_t input_size, size_t input_offset) {
+    if (input_offset < match_finder->run_offset || input_offset >= match_finder->run_end_offset) {
+        size_t run_end_offset = input_offset + 1;
+
+        run_end_offset += compare_run_length(input_buffer + run_end_offset, input_buffer[input_offset], input_size - run_end_offset);
+
+        match_finder->run_offset = input_offset;
+        match_finder->run_end_offset = run_end_offset;
+    }
+
+    return match_finder->run_end_offset - input_offset;
+}
+
+// Returns the same match as trying every offset from 1 to the maximum offset and keeping the first one with the longest length.
+static size_t match_finder_find(MatchFinder *match_finder, const u8 *input_buffer, size_t input_size, size_t input_offset, size_t maximum_offset, size_t maximum_length, size_t *match_offset) {
+    size_t best_offset = 0;
+    size_t best_length = 0;
+
+    if (maximum_length >= 3) {
+        size_t run_length = match_finder_run_length(match_finder, input_buffer, input_size, input_offset);
+
+        // Positions in a chain only get older, so the first candidate with a given length also has the smallest offset.
+        u32 position = match_finder->hash_heads[match_finder_hash(input_buffer + input_offset)];
 
-        size_t rle_match_value = 0;
-        size_t rle_match_length = 0;
+        while (position != MATCH_FINDER_EMPTY && (input_offset - position) <= maximum_offset) {
+            // A candidate can only be longer than the best match if it also matches the byte right after it.
+            if (best_length == 0 || input_buffer[position + best_length] == input_buffer[input_offset + best_length]) {
+                size_t length = compare_match_length(input_buffer + position, input_buffer + input_offset, maximum_length);
 
-        // Find the longest match in the RLE window.
-        {
-            size_t match_value = input_buffer[input_offset];
-            size_t match_length = 0;
+                if (length >= 3 && length > best_length) {
+                    best_offset = input_offset - position;
+                    best_length = length;
 
-            if (match_value != 0x00 && rle_window_maximum_length > RLE_SHORT_MAXIMUM_LENGTH) {
-                // We are matching a non-zero value, so the maximum length we are able to match is the maximum copy length.
-                rle_window_maximum_length = RLE_SHORT_MAXIMUM_LENGTH;
+                    if (length == maximum_length) {
+                        break;
+                    }
+                }
             }
 
-            for (size_t i = 0; i < rle_window_maximum_length; i++) {
-                if (input_buffer[input_offset + i] == match_value) {
-                    match_length++;
-                } else {
+            if (run_length >= 3 && position >= match_finder->run_offset) {
+                // Every candidate inside the same run matches up to the end of the run and no further, so skip to the ones before the run.
+                if ((input_offset - match_finder->run_offset) > maximum_offset) {
                     break;
                 }
-            }
 
-            if (match_length > rle_match_length) {
-                rle_match_value = match_value;
-                rle_match_length = match_length;
+                position = match_finder->hash_chain[match_finder->run_offset % MATCH_FINDER_CHAIN_SIZE];
+            } else {
+                position = match_finder->hash_chain[position % MATCH_FINDER_CHAIN_SIZE];
             }
         }
+    }
+
+    // Without a 3-byte match, the most recent position starting with the same bytes is the best match.
+    if (best_length == 0 && maximum_length >= 2) {
+        u32 position = match_finder->pair_heads[(input_buffer[input_offset] << 8) | input_buffer[input_offset + 1]];
+
+        if (position != MATCH_FINDER_EMPTY && (input_offset - position) <= maximum_offset) {
+            best_offset = input_offset - position;
+            best_length = 2;
+        }
+    }
+
+    if (best_length == 0 && maximum_length >= 1) {
+        u32 position = match_finder->byte_heads[input_buffer[input_offset]];
+
+        if (position != MATCH_FINDER_EMPTY && (input_offset - position) <= maximum_offset) {
+            best_offset = input_offset - position;
+            best_length = 1;
+        }
+    }
+
+    *match_offset = best_offset;
+
+    return best_length;
+}
+
+// Finds the longest sliding window match and RLE run at the input offset the way the efficient algorithm does.
+static void find_match_efficient(MatchFinder *match_finder, const u8 *input_buffer, size_t input_size, size_t input_offset, PositionMatch *match) {
+    size_t sliding_window_copy_maximum_length = 0;
+
+    // Find the maximum length of the sliding window copy, e.g. how many bytes can be copied without going out of bounds.
+    if ((input_size - input_offset) >= SLIDING_WINDOW_COPY_MAXIMUM_LENGTH) {
+        sliding_window_copy_maximum_length = SLIDING_WINDOW_COPY_MAXIMUM_LENGTH;
+    } else {
+        sliding_window_copy_maximum_length = input_size - input_offset;
+    }
+
+    size_t sliding_window_maximum_offset = 0;
+
+    // Find the maximum offset of the sliding window copy, e.g. how far back can we go to copy bytes.
+    if (input_offset >= SLIDING_WINDOW_SIZE_EFFICIENT) {
+        sliding_window_maximum_offset = SLIDING_WINDOW_SIZE_EFFICIENT;
+    } else {
+        sliding_window_maximum_offset = input_offset;
+    }
+
+    size_t rle_window_maximum_length = 0;
+
+    // Find the maximum length of the RLE window, e.g. how many bytes can be matched without going out of bounds.
+    if ((input_size - input_offset) >= RLE_LONG_MAXIMUM_LENGTH) {
+        rle_window_maximum_length = RLE_LONG_MAXIMUM_LENGTH;
+    } else {
+        rle_window_maximum_length = input_size - input_offset;
+    }
+
+    size_t sliding_window_match_offset = 0;
+    size_t sliding_window_match_length = 0;
+
+    // Find the longest match in the sliding window.
+    match_finder_update(match_finder, input_buffer, input_size, input_offset);
+    sliding_window_match_length = match_finder_find(match_finder, input_buffer, input_size, input_offset, sliding_window_maximum_offset, sliding_window_copy_maximum_length, &sliding_window_match_offset);
+
+    size_t rle_match_length = 0;
+
+    // Find the longest match in the RLE window.
+    {
+        size_t match_value = input_buffer[input_offset];
+        size_t match_length = 0;
+
+        if (match_value != 0x00 && rle_window_maximum_length > RLE_SHORT_MAXIMUM_LENGTH) {
+            // We are matching a non-zero value, so the maximum length we are able to match is the maximum copy length.
+            rle_window_maximum_length = RLE_SHORT_MAXIMUM_LENGTH;
+        }
+
+        match_length = match_finder_run_length(match_finder, input_buffer, input_size, input_offset);
+        if (match_length > rle_window_maximum_length) {
+            match_length = rle_window_maximum_length;
+        }
+
+        if (match_length > rle_match_length) {
+            rle_match_length = match_length;
+        }
+    }
+
+    match->sliding_window_match_offset = sliding_window_match_offset;
+    match->sliding_window_match_length = sliding_window_match_length;
+    match->rle_match_length = rle_match_length;
+}
+
+// Finds the longest sliding window match and RLE run at the input offset the way the accurate algorithm does.
+static void find_match_accurate(MatchFinder *match_finder, const u8 *input_buffer, size_t input_size, size_t input_offset, PositionMatch *match) {
+    size_t sliding_window_copy_maximum_length = 0;
+
+    // Find the maximum length of the sliding window copy, e.g. how many bytes can be copied without going out of bounds.
+    if ((input_size - input_offset) >= SLIDING_WINDOW_COPY_MAXIMUM_LENGTH) {
+        sliding_window_copy_maximum_length = SLIDING_WINDOW_COPY_MAXIMUM_LENGTH;
+    } else {
+        sliding_window_copy_maximum_length = input_size - input_offset;
+    }
+
+    size_t sliding_window_maximum_offset = 0;
+
+    //! First difference from the efficient algorithm.
+    // The sliding window size is 0x10 bytes smaller than the efficient algorithm.
+    // Find the maximum offset of the sliding window copy, e.g. how far back can we go to copy bytes.
+    if (input_offset >= SLIDING_WINDOW_SIZE_ACCURATE) {
+        sliding_window_maximum_offset = SLIDING_WINDOW_SIZE_ACCURATE;
+    } else {
+        sliding_window_maximum_offset = input_offset;
+    }
+
+    size_t rle_window_maximum_length = 0;
+
+    // Find the maximum length of the RLE window, e.g. how many bytes can be matched without going out of bounds.
+    if ((input_size - input_offset) >= RLE_LONG_MAXIMUM_LENGTH) {
+        rle_window_maximum_length = RLE_LONG_MAXIMUM_LENGTH;
+    } else {
+        rle_window_maximum_length = input_size - input_offset;
+    }
+    
+    //! Second difference from the efficient algorithm.
+    if (rle_window_maximum_length > RLE_SHORT_MAXIMUM_LENGTH) {
+        size_t i = (RLE_SHORT_MAXIMUM_LENGTH + 1);
+
+        // Skip ahead to where we are RLE_SHORT_MAXIMUM_LENGTH bytes away from the start of the next 0x400 block.
+        i += (RLE_SHORT_MAXIMUM_LENGTH + 0x400 - ((input_offset + i) % 0x400)) % 0x400;
+
+        if (i <= rle_window_maximum_length) {
+            rle_window_maximum_length = i;
+        }
+    }
+
+    size_t sliding_window_match_offset = 0;
+    size_t sliding_window_match_length = 0;
+
+    // Find the longest match in the sliding window.
+    match_finder_update(match_finder, input_buffer, input_size, input_offset);
+    sliding_window_match_length = match_finder_find(match_finder, input_buffer, input_size, input_offset, sliding_window_maximum_offset, sliding_window_copy_maximum_length, &sliding_window_match_offset);
+
+    size_t rle_match_length = 0;
+
+    // Find the longest match in the RLE window.
+    {
+        size_t match_value = input_buffer[input_offset];
+        size_t match_length = 0;
+
+        //! Third difference from the efficient algorithm. 
+        // For some reason, when emitting a COMMAND_RLE_WRITE_SHORT_ANY_VALUE, the maximum length is RLE_SHORT_MAXIMUM_LENGTH - 1 instead of RLE_SHORT_MAXIMUM_LENGTH.
+        if (match_value != 0x00 && rle_window_maximum_length > (RLE_SHORT_MAXIMUM_LENGTH - 1)) {
+            // We are matching a non-zero value, so the maximum length we are able to match is the maximum copy length.
+            rle_window_maximum_length = (RLE_SHORT_MAXIMUM_LENGTH - 1);
+        }
+
+        match_length = match_finder_run_length(match_finder, input_buffer, input_size, input_offset);
+        if (match_length > rle_window_maximum_length) {
+            match_length = rle_window_maximum_length;
+        }
+
+        //! Fourth difference from the efficient algorithm.
+        if (match_length > 0) {
+            rle_match_length = match_length;
+        }
+    }
+
+    match->sliding_window_match_offset = sliding_window_match_offset;
+    match->sliding_window_match_length = sliding_window_match_length;
+    match->rle_match_length = rle_match_length;
+}
+
+// Uses the precomputed matches if there are any, otherwise they get looked up while compressing.
+static size_t compress_efficient(const u8 *input_buffer, u8 *output_buffer, size_t input_size, const PositionMatch *matches) {
+    size_t input_offset = 0;
+    size_t output_offset = 4; // Skip the first 4 bytes since they are the compressed file size.
+
+    size_t input_last_processed_data_offset = 0;
+
+    MatchFinder *match_finder = NULL;
+    if (matches == NULL) {
+        match_finder = match_finder_create();
+        if (match_finder == NULL) {
+            return 0;
+        }
+    }
+
+    while (input_offset < input_size) {
+        PositionMatch match;
+
+        if (matches != NULL) {
+            match = matches[input_offset];
+        } else {
+            find_match_efficient(match_finder, input_buffer, input_size, input_offset, &match);
+        }
+
+        size_t sliding_window_match_offset = match.sliding_window_match_offset;
+        size_t sliding_window_match_length = match.sliding_window_match_length;
+        size_t rle_match_value = input_buffer[input_offset];
+        size_t rle_match_length = match.rle_match_length;
 
         u8 command = COMMAND_UNDEFINED;
 
@@ -91,7 +345,8 @@ size_t lzkn64_compress_efficient(const u8 *input_buffer, u8 *output_buffer, size
             command = COMMAND_SLIDING_WINDOW_COPY; // Takes up 2 bytes.
         } else if (rle_match_length >= 3) {
             if (rle_match_value == 0x00) {
-                if (rle_match_length <= RLE_SHORT_MAXIMUM_LENGTH) {
+                // 0xE0 | 0x1F would be COMMAND_RLE_WRITE_LONG_ZERO, so the longest short run of zeros is one byte shorter.
+                if (rle_match_length < RLE_SHORT_MAXIMUM_LENGTH) {
                     command = COMMAND_RLE_WRITE_SHORT_ZERO; // Takes up 1 byte.
                 } else if (rle_match_length <= RLE_LONG_MAXIMUM_LENGTH) {
                     command = COMMAND_RLE_WRITE_LONG_ZERO; // Takes up 2 bytes.
@@ -207,109 +462,40 @@ size_t lzkn64_compress_efficient(const u8 *input_buffer, u8 *output_buffer, size
     output_buffer[2] = (output_offset >> 8) & 0xFF;
     output_buffer[3] = output_offset & 0xFF;
     
+    match_finder_destroy(match_finder);
+
     // Return the output offset as the output size.
     return output_offset;
 }
 
-size_t lzkn64_compress_accurate(const u8 *input_buffer, u8 *output_buffer, size_t input_size) {
+// Uses the precomputed matches if there are any, otherwise they get looked up while compressing.
+static size_t compress_accurate(const u8 *input_buffer, u8 *output_buffer, size_t input_size, const PositionMatch *matches) {
     size_t input_offset = 0;
     size_t output_offset = 4; // Skip the first 4 bytes since they are the compressed file size.
 
     size_t input_last_processed_data_offset = 0;
 
-    while (input_offset < input_size) {
-        size_t sliding_window_copy_maximum_length = 0;
-
-        // Find the maximum length of the sliding window copy, e.g. how many bytes can be copied without going out of bounds.
-        if ((input_size - input_offset) >= SLIDING_WINDOW_COPY_MAXIMUM_LENGTH) {
-            sliding_window_copy_maximum_length = SLIDING_WINDOW_COPY_MAXIMUM_LENGTH;
-        } else {
-            sliding_window_copy_maximum_length = input_size - input_offset;
-        }
-
-        size_t sliding_window_maximum_offset = 0;
-
-        //! First difference from the efficient algorithm.
-        // The sliding window size is 0x10 bytes smaller than the efficient algorithm.
-        // Find the maximum offset of the sliding window copy, e.g. how far back can we go to copy bytes.
-        if (input_offset >= SLIDING_WINDOW_SIZE_ACCURATE) {
-            sliding_window_maximum_offset = SLIDING_WINDOW_SIZE_ACCURATE;
-        } else {
-            sliding_window_maximum_offset = input_offset;
+    MatchFinder *match_finder = NULL;
+    if (matches == NULL) {
+        match_finder = match_finder_create();
+        if (match_finder == NULL) {
+            return 0;
         }
+    }
 
-        size_t rle_window_maximum_length = 0;
+    while (input_offset < input_size) {
+        PositionMatch match;
 
-        // Find the maximum length of the RLE window, e.g. how many bytes can be matched without going out of bounds.
-        if ((input_size - input_offset) >= RLE_LONG_MAXIMUM_LENGTH) {
-            rle_window_maximum_length = RLE_LONG_MAXIMUM_LENGTH;
+        if (matches != NULL) {
+            match = matches[input_offset];
         } else {
-            rle_window_maximum_length = input_size - input_offset;
-        }
-        
-        //! Second difference from the efficient algorithm.
-        if (rle_window_maximum_length > RLE_SHORT_MAXIMUM_LENGTH) {
-            for (size_t i = (RLE_SHORT_MAXIMUM_LENGTH + 1); i <= rle_window_maximum_length; i++) {
-                size_t j = (input_offset + i) & 0xFFF;
-
-                // Check every 0x400 to see if we are RLE_SHORT_MAXIMUM_LENGTH bytes away from the start of the 0x400 block.
-                if (j % 0x400 == RLE_SHORT_MAXIMUM_LENGTH) {
-                    rle_window_maximum_length = i;
-                    break;
-                }
-            }
+            find_match_accurate(match_finder, input_buffer, input_size, input_offset, &match);
         }
 
-        size_t sliding_window_match_offset = 0;
-        size_t sliding_window_match_length = 0;
-
-        // Find the longest match in the sliding window.
-        for (size_t i = 1; i <= sliding_window_maximum_offset; i++) {
-            size_t match_length = 0;
-
-            for (size_t j = 0; j < sliding_window_copy_maximum_length; j++) {
-                if (input_buffer[input_offset - i + j] == input_buffer[input_offset + j]) {
-                    match_length++;
-                } else {
-                    break;
-                }
-            }
-
-            if (match_length > sliding_window_match_length) {
-                sliding_window_match_offset = i;
-                sliding_window_match_length = match_length;
-            }
-        }
-
-        size_t rle_match_value = 0;
-        size_t rle_match_length = 0;
-
-        // Find the longest match in the RLE window.
-        {
-            size_t match_value = input_buffer[input_offset];
-            size_t match_length = 0;
-
-            //! Third difference from the efficient algorithm. 
-            // For some reason, when emitting a COMMAND_RLE_WRITE_SHORT_ANY_VALUE, the maximum length is RLE_SHORT_MAXIMUM_LENGTH - 1 instead of RLE_SHORT_MAXIMUM_LENGTH.
-            if (match_value != 0x00 && rle_window_maximum_length > (RLE_SHORT_MAXIMUM_LENGTH - 1)) {
-                // We are matching a non-zero value, so the maximum length we are able to match is the maximum copy length.
-                rle_window_maximum_length = (RLE_SHORT_MAXIMUM_LENGTH - 1);
-            }
-
-            for (size_t i = 0; i < rle_window_maximum_length; i++) {
-                if (input_buffer[input_offset + i] == match_value) {
-                    match_length++;
-                } else {
-                    break;
-                }
-            }
-
-            //! Fourth difference from the efficient algorithm.
-            if (match_length > 0) {
-                rle_match_value = match_value;
-                rle_match_length = match_length;
-            }
-        }
+        size_t sliding_window_match_offset = match.sliding_window_match_offset;
+        size_t sliding_window_match_length = match.sliding_window_match_length;
+        size_t rle_match_value = input_buffer[input_offset];
+        size_t rle_match_length = match.rle_match_length;
 
         u8 command = COMMAND_UNDEFINED;
 
@@ -435,74 +621,684 @@ size_t lzkn64_compress_accurate(const u8 *input_buffer, u8 *output_buffer, size_
     output_buffer[2] = (output_offset >> 8) & 0xFF;
     output_buffer[3] = output_offset & 0xFF;
 
+    match_finder_destroy(match_finder);
+
     // Return the output offset as the output size.
     return output_offset;
 }
 
-size_t lzkn64_decompress(const u8 *input_buffer, u8 *output_buffer, size_t input_size) {
+static void *find_matches_task(void *argument) {
+    FindMatchesTask *task = argument;
+
+    MatchFinder *match_finder = match_finder_create();
+    if (match_finder == NULL) {
+        task->success = false;
+        return NULL;
+    }
+
+    // Only the positions inside the sliding window of the first position have to be indexed before starting.
+    if (task->start_offset > MATCH_FINDER_CHAIN_SIZE) {
+        match_finder->insert_offset = task->start_offset - MATCH_FINDER_CHAIN_SIZE;
+    }
+
+    for (size_t i = task->start_offset; i < task->end_offset; i++) {
+        task->find_match(match_finder, task->input_buffer, task->input_size, i, &task->matches[i]);
+    }
+
+    match_finder_destroy(match_finder);
+
+    task->success = true;
+    return NULL;
+}
+
+// Finds the matches for every input position, split into one block of positions per thread.
+static PositionMatch *find_matches(const u8 *input_buffer, size_t input_size, size_t thread_count, FindMatchFunction find_match) {
+    PositionMatch *matches = malloc(input_size * sizeof(PositionMatch));
+    FindMatchesTask *tasks = calloc(thread_count, sizeof(FindMatchesTask));
+    pthread_t *threads = calloc(thread_count, sizeof(pthread_t));
+    bool *is_thread_started = calloc(thread_count, sizeof(bool));
+
+    if (matches == NULL || tasks == NULL || threads == NULL || is_thread_started == NULL) {
+        free(matches);
+        free(tasks);
+        free(threads);
+        free(is_thread_started);
+        return NULL;
+    }
+
+    size_t block_size = (input_size + thread_count - 1) / thread_count;
+
+    for (size_t i = 0; i < thread_count; i++) {
+        tasks[i].find_match = find_match;
+        tasks[i].input_buffer = input_buffer;
+        tasks[i].input_size = input_size;
+        tasks[i].start_offset = (i * block_size) < input_size ? (i * block_size) : input_size;
+        tasks[i].end_offset = ((i + 1) * block_size) < input_size ? ((i + 1) * block_size) : input_size;
+        tasks[i].matches = matches;
+
+        // The first block is handled by the calling thread.
+        if (i > 0) {
+            is_thread_started[i] = pthread_create(&threads[i], NULL, find_matches_task, &tasks[i]) == 0;
+        }
+    }
+
+    bool success = true;
+
+    for (size_t i = 0; i < thread_count; i++) {
+        if (is_thread_started[i]) {
+            pthread_join(threads[i], NULL);
+        } else {
+            // Either the first block or a thread couldn't be started, do the work here instead.
+            find_matches_task(&tasks[i]);
+        }
+
+        success = success && tasks[i].success;
+    }
+
+    free(tasks);
+    free(threads);
+    free(is_thread_started);
+
+    if (!success) {
+        free(matches);
+        return NULL;
+    }
+
+    return matches;
+}
+
+// Picks the commands that give the smallest possible output.
+// Going backwards through the input, the cheapest way to encode everything after each position is known before looking at it.
+static size_t compress_optimal(const u8 *input_buffer, u8 *output_buffer, size_t input_size, const PositionMatch *matches) {
+    size_t *costs = malloc((input_size + 1) * sizeof(size_t));
+    u8 *commands = malloc((input_size + 1) * sizeof(u8));
+    u16 *lengths = malloc((input_size + 1) * sizeof(u16));
+
+    if (costs == NULL || commands == NULL || lengths == NULL) {
+        free(costs);
+        free(commands);
+        free(lengths);
+        return 0;
+    }
+
+    costs[input_size] = 0;
+
+    for (size_t input_offset = input_size; input_offset-- > 0;) {
+        size_t best_cost = SIZE_MAX;
+        u8 best_command = COMMAND_UNDEFINED;
+        size_t best_length = 0;
+
+        // Any length up to the longest match can be copied from the sliding window. Takes up 2 bytes.
+        for (size_t length = 2; length <= matches[input_offset].sliding_window_match_length; length++) {
+            if ((2 + costs[input_offset + length]) < best_cost) {
+                best_cost = 2 + costs[input_offset + length];
+                best_command = COMMAND_SLIDING_WINDOW_COPY;
+                best_length = length;
+            }
+        }
+
+        if (input_buffer[input_offset] == 0x00) {
+            for (size_t length = 2; length <= matches[input_offset].rle_match_length && length <= (RLE_SHORT_MAXIMUM_LENGTH - 1); length++) {
+                if ((1 + costs[input_offset + length]) < best_cost) {
+                    best_cost = 1 + costs[input_offset + length];
+                    best_command = COMMAND_RLE_WRITE_SHORT_ZERO; // Takes up 1 byte.
+                    best_length = length;
+                }
+            }
+
+            // Shorter lengths are always cheaper with COMMAND_RLE_WRITE_SHORT_ZERO.
+            for (size_t length = RLE_SHORT_MAXIMUM_LENGTH; length <= matches[input_offset].rle_match_length; length++) {
+                if ((2 + costs[input_offset + length]) < best_cost) {
+                    best_cost = 2 + costs[input_offset + length];
+                    best_command = COMMAND_RLE_WRITE_LONG_ZERO; // Takes up 2 bytes.
+                    best_length = length;
+                }
+            }
+        } else {
+            for (size_t length = 2; length <= matches[input_offset].rle_match_length; length++) {
+                if ((2 + costs[input_offset + length]) < best_cost) {
+                    best_cost = 2 + costs[input_offset + length];
+                    best_command = COMMAND_RLE_WRITE_SHORT_ANY_VALUE; // Takes up 2 bytes.
+                    best_length = length;
+                }
+            }
+        }
+
+        // Raw data can always be copied. Takes up 1 byte plus the copied bytes.
+        for (size_t length = 1; length <= RAW_COPY_MAXIMUM_LENGTH && (input_offset + length) <= input_size; length++) {
+            if ((1 + length + costs[input_offset + length]) < best_cost) {
+                best_cost = 1 + length + costs[input_offset + length];
+                best_command = COMMAND_RAW_COPY;
+                best_length = length;
+            }
+        }
+
+        costs[input_offset] = best_cost;
+        commands[input_offset] = best_command;
+        lengths[input_offset] = best_length;
+    }
+
+    size_t input_offset = 0;
+    size_t output_offset = 4; // Skip the first 4 bytes since they are the compressed file size.
+
+    // Write out the picked commands from the start of the input.
+    while (input_offset < input_size) {
+        u8 command = commands[input_offset];
+        size_t length = lengths[input_offset];
+
+        if (command == COMMAND_SLIDING_WINDOW_COPY) {
+            size_t offset = matches[input_offset].sliding_window_match_offset;
+
+            output_buffer[output_offset++] = COMMAND_SLIDING_WINDOW_COPY | (((length - 2) << 2) & COMMAND_SLIDING_WINDOW_COPY_LENGTH_MASK) | ((offset >> 8) & COMMAND_SLIDING_WINDOW_COPY_OFFSET_FIRST_BYTE_MASK);
+            output_buffer[output_offset++] = offset & COMMAND_SLIDING_WINDOW_COPY_OFFSET_SECOND_BYTE_MASK;
+        } else if (command == COMMAND_RAW_COPY) {
+            output_buffer[output_offset++] = COMMAND_RAW_COPY | (length & COMMAND_RAW_COPY_LENGTH_MASK);
+
+            for (size_t i = 0; i < length; i++) {
+                output_buffer[output_offset++] = input_buffer[input_offset + i];
+            }
+        } else if (command == COMMAND_RLE_WRITE_SHORT_ANY_VALUE) {
+            output_buffer[output_offset++] = COMMAND_RLE_WRITE_SHORT_ANY_VALUE | ((length - 2) & COMMAND_RLE_WRITE_SHORT_ANY_VALUE_LENGTH_MASK);
+            output_buffer[output_offset++] = input_buffer[input_offset];
+        } else if (command == COMMAND_RLE_WRITE_SHORT_ZERO) {
+            output_buffer[output_offset++] = COMMAND_RLE_WRITE_SHORT_ZERO | ((length - 2) & COMMAND_RLE_WRITE_SHORT_ZERO_LENGTH_MASK);
+        } else if (command == COMMAND_RLE_WRITE_LONG_ZERO) {
+            output_buffer[output_offset++] = COMMAND_RLE_WRITE_LONG_ZERO;
+            output_buffer[output_offset++] = (length - 2) & COMMAND_RLE_WRITE_LONG_ZERO_LENGTH_MASK;
+        }
+
+        input_offset += length;
+    }
+
+    free(costs);
+    free(commands);
+    free(lengths);
+
+    // Write the compressed size into the first 4 bytes of the output buffer.
+    output_buffer[0] = (output_offset >> 24) & 0x7F;
+    output_buffer[1] = (output_offset >> 16) & 0xFF;
+    output_buffer[2] = (output_offset >> 8) & 0xFF;
+    output_buffer[3] = output_offset & 0xFF;
+
+    // Return the output offset as the output size.
+    return output_offset;
+}
+
+size_t lzkn64_compress_efficient(const u8 *input_buffer, u8 *output_buffer, size_t input_size) {
+    return compress_efficient(input_buffer, output_buffer, input_size, NULL);
+}
+
+size_t lzkn64_compress_efficient_threaded(const u8 *input_buffer, u8 *output_buffer, size_t input_size, size_t thread_count) {
+    if (thread_count <= 1 || input_size < LZKN64_THREADED_MINIMUM_SIZE) {
+        return compress_efficient(input_buffer, output_buffer, input_size, NULL);
+    }
+
+    PositionMatch *matches = find_matches(input_buffer, input_size, thread_count, find_match_efficient);
+    if (matches == NULL) {
+        return 0;
+    }
+
+    size_t output_size = compress_efficient(input_buffer, output_buffer, input_size, matches);
+
+    free(matches);
+
+    return output_size;
+}
+
+size_t lzkn64_compress_accurate(const u8 *input_buffer, u8 *output_buffer, size_t input_size) {
+    return compress_accurate(input_buffer, output_buffer, input_size, NULL);
+}
+
+size_t lzkn64_compress_accurate_threaded(const u8 *input_buffer, u8 *output_buffer, size_t input_size, size_t thread_count) {
+    if (thread_count <= 1 || input_size < LZKN64_THREADED_MINIMUM_SIZE) {
+        return compress_accurate(input_buffer, output_buffer, input_size, NULL);
+    }
+
+    PositionMatch *matches = find_matches(input_buffer, input_size, thread_count, find_match_accurate);
+    if (matches == NULL) {
+        return 0;
+    }
+
+    size_t output_size = compress_accurate(input_buffer, output_buffer, input_size, matches);
+
+    free(matches);
+
+    return output_size;
+}
+
+size_t lzkn64_compress_optimal(const u8 *input_buffer, u8 *output_buffer, size_t input_size) {
+    return lzkn64_compress_optimal_threaded(input_buffer, output_buffer, input_size, 1);
+}
+
+size_t lzkn64_compress_optimal_threaded(const u8 *input_buffer, u8 *output_buffer, size_t input_size, size_t thread_count) {
+    // No threads at all means the calling thread does the work alone.
+    if (thread_count < 1 || input_size < LZKN64_THREADED_MINIMUM_SIZE) {
+        thread_count = 1;
+    }
+
+    PositionMatch *matches = NULL;
+
+    // The longest matches within the bigger sliding window of the efficient algorithm are all that's needed.
+    if (input_size > 0) {
+        matches = find_matches(input_buffer, input_size, thread_count, find_match_efficient);
+        if (matches == NULL) {
+            return 0;
+        }
+    }
+
+    size_t output_size = compress_optimal(input_buffer, output_buffer, input_size, matches);
+
+    free(matches);
+
+    return output_size;
+}
+
+bool lzkn64_decompress_checked(const u8 *input_buffer, size_t input_size, u8 *output_buffer, size_t output_capacity, size_t *input_consumed, size_t *output_produced) {
     size_t input_offset = 4;
     size_t output_offset = 0;
 
+    *input_consumed = 0;
+    *output_produced = 0;
+
+    if (input_size < 4) {
+        return false;
+    }
+
     size_t compressed_size = bswap_32(*(u32*)(input_buffer));
-    if (compressed_size > input_size) {
-        return 0;
+    if (compressed_size > input_size || compressed_size < 4) {
+        return false;
     }
-    
+
     while (input_offset < compressed_size) {
         u8 command = input_buffer[input_offset++];
 
-        if (command >= COMMAND_SLIDING_WINDOW_COPY_START && command <= COMMAND_SLIDING_WINDOW_COPY_END) {
-            u8 length = (command & COMMAND_SLIDING_WINDOW_COPY_LENGTH_MASK) >> 2;
-            u16 offset_first_byte = (command & COMMAND_SLIDING_WINDOW_COPY_OFFSET_FIRST_BYTE_MASK) << 8;
-            u8 offset_second_byte = input_buffer[input_offset++];
-            u16 offset = (offset_first_byte | offset_second_byte) & COMMAND_SLIDING_WINDOW_COPY_OFFSET_MAX_MASK;
+        if (command <= COMMAND_SLIDING_WINDOW_COPY_END) {
+            if (input_offset >= compressed_size) {
+                return false;
+            }
 
-            // Add 2 to get the actual length since 2 is the minimum length.
-            length += 2;
-            
-            for (size_t i = 0; i < length; i++) {
-                output_buffer[output_offset] = output_buffer[output_offset - offset];
-                output_offset++;
+            size_t length = ((command & COMMAND_SLIDING_WINDOW_COPY_LENGTH_MASK) >> 2) + 2;
+            size_t offset = (((command & COMMAND_SLIDING_WINDOW_COPY_OFFSET_FIRST_BYTE_MASK) << 8) | input_buffer[input_offset++]) & COMMAND_SLIDING_WINDOW_COPY_OFFSET_MAX_MASK;
+
+            // The offset has to point to data that was already decompressed.
+            if (offset == 0 || offset > output_offset || length > (output_capacity - output_offset)) {
+                return false;
+            }
+
+            u8 *destination = output_buffer + output_offset;
+            const u8 *source = destination - offset;
+
+            if (offset >= length) {
+                // Source and destination don't overlap, copy everything at once.
+                memcpy(destination, source, length);
+            } else if (offset == 1) {
+                // Repeats the last byte.
+                memset(destination, *source, length);
+            } else {
+                // The copy reads bytes it has just written, so it has to go one byte at a time.
+                for (size_t i = 0; i < length; i++) {
+                    destination[i] = source[i];
+                }
             }
+
+            output_offset += length;
         } else if (command >= COMMAND_RAW_COPY_START && command <= COMMAND_RAW_COPY_END) {
-            u8 length = command & COMMAND_RAW_COPY_LENGTH_MASK;
-            
-            for (size_t i = 0; i < length; i++) {
-                output_buffer[output_offset++] = input_buffer[input_offset++];
+            size_t length = command & COMMAND_RAW_COPY_LENGTH_MASK;
+
+            if (length > (compressed_size - input_offset) || length > (output_capacity - output_offset)) {
+                return false;
             }
+
+            memcpy(output_buffer + output_offset, input_buffer + input_offset, length);
+
+            input_offset += length;
+            output_offset += length;
         } else if (command >= COMMAND_RLE_WRITE_SHORT_ANY_VALUE_START && command <= COMMAND_RLE_WRITE_SHORT_ANY_VALUE_END) {
-            u8 length = command & COMMAND_RLE_WRITE_SHORT_ANY_VALUE_LENGTH_MASK;
+            if (input_offset >= compressed_size) {
+                return false;
+            }
+
+            size_t length = (command & COMMAND_RLE_WRITE_SHORT_ANY_VALUE_LENGTH_MASK) + 2;
             u8 value = input_buffer[input_offset++];
- 
-            // Add 2 to get the actual length since 2 is the minimum length.
-            length += 2;
 
-            for (size_t i = 0; i < length; i++) {
-                output_buffer[output_offset++] = value;
+            if (length > (output_capacity - output_offset)) {
+                return false;
             }
-        } else if (command >= COMMAND_RLE_WRITE_SHORT_ZERO_START && command <= COMMAND_RLE_WRITE_SHORT_ZERO_END) {
-            u8 length = command & COMMAND_RLE_WRITE_SHORT_ZERO_LENGTH_MASK;
 
-            // Add 2 to get the actual length since 2 is the minimum length.
-            length += 2;
+            memset(output_buffer + output_offset, value, length);
 
-            for (size_t i = 0; i < length; i++) {
-                output_buffer[output_offset++] = 0;
+            output_offset += length;
+        } else if (command >= COMMAND_RLE_WRITE_SHORT_ZERO_START && command <= COMMAND_RLE_WRITE_SHORT_ZERO_END) {
+            size_t length = (command & COMMAND_RLE_WRITE_SHORT_ZERO_LENGTH_MASK) + 2;
+
+            if (length > (output_capacity - output_offset)) {
+                return false;
             }
+
+            memset(output_buffer + output_offset, 0, length);
+
+            output_offset += length;
         } else if (command == COMMAND_RLE_WRITE_LONG_ZERO) {
-            u16 length = input_buffer[input_offset++] & COMMAND_RLE_WRITE_LONG_ZERO_LENGTH_MASK;
+            if (input_offset >= compressed_size) {
+                return false;
+            }
 
-            // Add 2 to get the actual length since 2 is the minimum length.
-            length += 2;
+            size_t length = (input_buffer[input_offset++] & COMMAND_RLE_WRITE_LONG_ZERO_LENGTH_MASK) + 2;
 
-            for (size_t i = 0; i < length; i++) {
-                output_buffer[output_offset++] = 0;
+            if (length > (output_capacity - output_offset)) {
+                return false;
             }
+
+            memset(output_buffer + output_offset, 0, length);
+
+            output_offset += length;
         } else {
             // Invalid command.
+            return false;
         }
     }
 
+    *input_consumed = input_offset;
+    *output_produced = output_offset;
+
+    return true;
+}
+
+size_t lzkn64_decompress(const u8 *input_buffer, u8 *output_buffer, size_t input_size) {
+    size_t input_consumed = 0;
+    size_t output_produced = 0;
+
+    // The caller has to make sure the output buffer is big enough.
+    if (!lzkn64_decompress_checked(input_buffer, input_size, output_buffer, SIZE_MAX, &input_consumed, &output_produced)) {
+        return 0;
+    }
+
     // Return the output offset as the output size.
-    return output_offset;
+    return output_produced;
+}
+
+bool lzkn64_decompressed_size(const u8 *input_buffer, size_t input_size, size_t *decompressed_size) {
+    size_t input_offset = 4;
+    size_t output_offset = 0;
+
+    *decompressed_size = 0;
+
+    if (input_size < 4) {
+        return false;
+    }
+
+    size_t compressed_size = bswap_32(*(u32*)(input_buffer));
+    if (compressed_size > input_size || compressed_size < 4) {
+        return false;
+    }
+
+    while (input_offset < compressed_size) {
+        u8 command = input_buffer[input_offset++];
+
+        if (command <= COMMAND_SLIDING_WINDOW_COPY_END) {
+            if (input_offset >= compressed_size) {
+                return false;
+            }
+
+            size_t offset = (((command & COMMAND_SLIDING_WINDOW_COPY_OFFSET_FIRST_BYTE_MASK) << 8) | input_buffer[input_offset++]) & COMMAND_SLIDING_WINDOW_COPY_OFFSET_MAX_MASK;
+
+            // The offset has to point to data that was already decompressed.
+            if (offset == 0 || offset > output_offset) {
+                return false;
+            }
+
+            output_offset += ((command & COMMAND_SLIDING_WINDOW_COPY_LENGTH_MASK) >> 2) + 2;
+        } else if (command >= COMMAND_RAW_COPY_START && command <= COMMAND_RAW_COPY_END) {
+            size_t length = command & COMMAND_RAW_COPY_LENGTH_MASK;
+
+            if (length > (compressed_size - input_offset)) {
+                return false;
+            }
+
+            // Skip the raw data, only the length matters.
+            input_offset += length;
+            output_offset += length;
+        } else if (command >= COMMAND_RLE_WRITE_SHORT_ANY_VALUE_START && command <= COMMAND_RLE_WRITE_SHORT_ANY_VALUE_END) {
+            if (input_offset >= compressed_size) {
+                return false;
+            }
+
+            input_offset++;
+            output_offset += (command & COMMAND_RLE_WRITE_SHORT_ANY_VALUE_LENGTH_MASK) + 2;
+        } else if (command >= COMMAND_RLE_WRITE_SHORT_ZERO_START && command <= COMMAND_RLE_WRITE_SHORT_ZERO_END) {
+            output_offset += (command & COMMAND_RLE_WRITE_SHORT_ZERO_LENGTH_MASK) + 2;
+        } else if (command == COMMAND_RLE_WRITE_LONG_ZERO) {
+            if (input_offset >= compressed_size) {
+                return false;
+            }
+
+            output_offset += (input_buffer[input_offset++] & COMMAND_RLE_WRITE_LONG_ZERO_LENGTH_MASK) + 2;
+        } else {
+            // Invalid command.
+            return false;
+        }
+    }
+
+    *decompressed_size = output_offset;
+
+    return true;
+}
+
+// Returns how many bytes the command has including the command byte, or 0 if it's not a valid command.
+static size_t stream_command_size(u8 command) {
+    if (command <= COMMAND_SLIDING_WINDOW_COPY_END) {
+        return 2;
+    } else if (command >= COMMAND_RAW_COPY_START && command <= COMMAND_RAW_COPY_END) {
+        return 1;
+    } else if (command >= COMMAND_RLE_WRITE_SHORT_ANY_VALUE_START && command <= COMMAND_RLE_WRITE_SHORT_ANY_VALUE_END) {
+        return 2;
+    } else if (command >= COMMAND_RLE_WRITE_SHORT_ZERO_START && command <= COMMAND_RLE_WRITE_SHORT_ZERO_END) {
+        return 1;
+    } else if (command == COMMAND_RLE_WRITE_LONG_ZERO) {
+        return 2;
+    }
+
+    return 0;
+}
+
+static inline size_t stream_free_space(const Lzkn64Stream *stream) {
+    return stream->ring_size - (stream->output_offset - stream->read_offset);
+}
+
+// The writes below wrap around the end of the ring buffer, the caller has to make sure there is enough free space.
+static void stream_write_value(Lzkn64Stream *stream, u8 value, size_t length) {
+    size_t position = stream->output_offset % stream->ring_size;
+    size_t first_length = length < (stream->ring_size - position) ? length : (stream->ring_size - position);
+
+    memset(stream->ring_buffer + position, value, first_length);
+    memset(stream->ring_buffer, value, length - first_length);
+
+    stream->output_offset += length;
+}
+
+static void stream_write_buffer(Lzkn64Stream *stream, const u8 *buffer, size_t length) {
+    size_t position = stream->output_offset % stream->ring_size;
+    size_t first_length = length < (stream->ring_size - position) ? length : (stream->ring_size - position);
+
+    memcpy(stream->ring_buffer + position, buffer, first_length);
+    memcpy(stream->ring_buffer, buffer + first_length, length - first_length);
+
+    stream->output_offset += length;
+}
+
+static void stream_write_window(Lzkn64Stream *stream, size_t offset, size_t length) {
+    size_t destination = stream->output_offset % stream->ring_size;
+    size_t source = (stream->output_offset - offset) % stream->ring_size;
+
+    // The copy can read bytes it has just written, so it has to go one byte at a time.
+    for (size_t i = 0; i < length; i++) {
+        stream->ring_buffer[destination] = stream->ring_buffer[source];
+
+        if (++destination == stream->ring_size) {
+            destination = 0;
+        }
+        if (++source == stream->ring_size) {
+            source = 0;
+        }
+    }
+
+    stream->output_offset += length;
+}
+
+bool lzkn64_stream_initialize(Lzkn64Stream *stream, u8 *ring_buffer, size_t ring_size) {
+    if (ring_size < LZKN64_STREAM_MINIMUM_RING_SIZE) {
+        return false;
+    }
+
+    stream->ring_buffer = ring_buffer;
+    stream->ring_size = ring_size;
+    stream->output_offset = 0;
+    stream->read_offset = 0;
+    stream->input_offset = 0;
+    stream->compressed_size = 0;
+    stream->command_size = 0;
+    stream->raw_copy_remaining = 0;
+    stream->status = LZKN64_STREAM_STATUS_NEED_INPUT;
+
+    return true;
+}
+
+Lzkn64StreamStatus lzkn64_stream_decompress(Lzkn64Stream *stream, const u8 *input_buffer, size_t input_size, size_t *input_consumed) {
+    size_t offset = 0;
+
+    while (stream->status != LZKN64_STREAM_STATUS_DONE && stream->status != LZKN64_STREAM_STATUS_ERROR) {
+        if (stream->input_offset < 4) {
+            // The header is the big endian size of the compressed file.
+            if (offset == input_size) {
+                stream->status = LZKN64_STREAM_STATUS_NEED_INPUT;
+                break;
+            }
+
+            stream->compressed_size = (stream->compressed_size << 8) | input_buffer[offset++];
+            stream->input_offset++;
+
+            if (stream->input_offset == 4 && stream->compressed_size < 4) {
+                stream->status = LZKN64_STREAM_STATUS_ERROR;
+            }
+            continue;
+        }
+
+        if (stream->raw_copy_remaining > 0) {
+            // Raw bytes are copied as soon as they arrive, a raw copy can be split across chunks.
+            size_t length = stream->raw_copy_remaining;
+
+            if (length > stream_free_space(stream)) {
+                length = stream_free_space(stream);
+            }
+            if (length == 0) {
+                stream->status = LZKN64_STREAM_STATUS_OUTPUT_FULL;
+                break;
+            }
+            if (length > (input_size - offset)) {
+                length = input_size - offset;
+            }
+            if (length == 0) {
+                stream->status = LZKN64_STREAM_STATUS_NEED_INPUT;
+                break;
+            }
+
+            stream_write_buffer(stream, input_buffer + offset, length);
+
+            offset += length;
+            stream->input_offset += length;
+            stream->raw_copy_remaining -= length;
+            continue;
+        }
+
+        if (stream->command_size == 0 && stream->input_offset == stream->compressed_size) {
+            stream->status = LZKN64_STREAM_STATUS_DONE;
+            break;
+        }
+
+        if (stream->command_size == 0 || stream->command_size < stream_command_size(stream->command[0])) {
+            if (offset == input_size) {
+                stream->status = LZKN64_STREAM_STATUS_NEED_INPUT;
+                break;
+            }
+
+            stream->command[stream->command_size++] = input_buffer[offset++];
+            stream->input_offset++;
+
+            // Invalid command or the command doesn't fit into the compressed file.
+            size_t command_size = stream_command_size(stream->command[0]);
+            if (command_size == 0 || (stream->command_size < command_size && stream->input_offset == stream->compressed_size)) {
+                stream->status = LZKN64_STREAM_STATUS_ERROR;
+            }
+            continue;
+        }
+
+        // The command is complete, run it once the whole output fits into the ring buffer.
+        u8 command = stream->command[0];
+        size_t length;
+
+        if (command <= COMMAND_SLIDING_WINDOW_COPY_END) {
+            length = ((command & COMMAND_SLIDING_WINDOW_COPY_LENGTH_MASK) >> 2) + 2;
+        } else if (command >= COMMAND_RAW_COPY_START && command <= COMMAND_RAW_COPY_END) {
+            length = command & COMMAND_RAW_COPY_LENGTH_MASK;
+
+            if (length > (stream->compressed_size - stream->input_offset)) {
+                stream->status = LZKN64_STREAM_STATUS_ERROR;
+                break;
+            }
+
+            stream->raw_copy_remaining = length;
+            stream->command_size = 0;
+            continue;
+        } else if (command >= COMMAND_RLE_WRITE_SHORT_ANY_VALUE_START && command <= COMMAND_RLE_WRITE_SHORT_ANY_VALUE_END) {
+            length = (command & COMMAND_RLE_WRITE_SHORT_ANY_VALUE_LENGTH_MASK) + 2;
+        } else if (command >= COMMAND_RLE_WRITE_SHORT_ZERO_START && command <= COMMAND_RLE_WRITE_SHORT_ZERO_END) {
+            length = (command & COMMAND_RLE_WRITE_SHORT_ZERO_LENGTH_MASK) + 2;
+        } else {
+            length = (stream->command[1] & COMMAND_RLE_WRITE_LONG_ZERO_LENGTH_MASK) + 2;
+        }
+
+        if (length > stream_free_space(stream)) {
+            stream->status = LZKN64_STREAM_STATUS_OUTPUT_FULL;
+            break;
+        }
+
+        if (command <= COMMAND_SLIDING_WINDOW_COPY_END) {
+            size_t window_offset = (((command & COMMAND_SLIDING_WINDOW_COPY_OFFSET_FIRST_BYTE_MASK) << 8) | stream->command[1]) & COMMAND_SLIDING_WINDOW_COPY_OFFSET_MAX_MASK;
+
+            // The offset has to point to data that was already decompressed.
+            if (window_offset == 0 || window_offset > stream->output_offset) {
+                stream->status = LZKN64_STREAM_STATUS_ERROR;
+                break;
+            }
+
+            stream_write_window(stream, window_offset, length);
+        } else if (command >= COMMAND_RLE_WRITE_SHORT_ANY_VALUE_START && command <= COMMAND_RLE_WRITE_SHORT_ANY_VALUE_END) {
+            stream_write_value(stream, stream->command[1], length);
+        } else {
+            stream_write_value(stream, 0, length);
+        }
+
+        stream->command_size = 0;
+    }
+
+    *input_consumed = offset;
+
+    return stream->status;
+}
+
+size_t lzkn64_stream_read(Lzkn64Stream *stream, u8 *output_buffer, size_t output_size) {
+    size_t length = stream->output_offset - stream->read_offset;
+    if (length > output_size) {
+        length = output_size;
+    }
+
+    size_t position = stream->read_offset % stream->ring_size;
+    size_t first_length = length < (stream->ring_size - position) ? length : (stream->ring_size - position);
+
+    memcpy(output_buffer, stream->ring_buffer + position, first_length);
+    memcpy(output_buffer + first_length, stream->ring_buffer, length - first_length);
+
+    stream->read_offset += length;
+
+    return length;
 }
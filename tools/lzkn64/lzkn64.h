@@ -45,6 +45,11 @@
 #define RAW_COPY_MAXIMUM_LENGTH 0x1F
 #define RLE_SHORT_MAXIMUM_LENGTH 0x1F + 2
 #define RLE_LONG_MAXIMUM_LENGTH 0xFF + 2
+#define LZKN64_THREADED_MINIMUM_SIZE 0x10000 // Smaller files aren't worth starting threads for.
+
+// Biggest possible compressed size for an input size, including the header and a padding byte.
+// A raw copy of a single byte takes 2 bytes, every other command takes at most as many bytes as it writes.
+#define LZKN64_COMPRESS_BOUND(size) (((size) * 2) + 8)
 
 // Very slightly more efficient compression algorithm that doesn't match the games exactly.
 size_t lzkn64_compress_efficient(const u8 *input_buffer, u8 *output_buffer, size_t input_size);
@@ -52,6 +57,60 @@ size_t lzkn64_compress_efficient(const u8 *input_buffer, u8 *output_buffer, size
 // Matches the compression algorithm used in the actual games exactly.
 size_t lzkn64_compress_accurate(const u8 *input_buffer, u8 *output_buffer, size_t input_size);
 
+// Finds the smallest possible output for the input. Decompresses like the other algorithms, but never matches the games.
+size_t lzkn64_compress_optimal(const u8 *input_buffer, u8 *output_buffer, size_t input_size);
+
+// Same as the functions above, but the matches for every input position are searched for on multiple threads first.
+// The output is identical to the single threaded functions.
+size_t lzkn64_compress_efficient_threaded(const u8 *input_buffer, u8 *output_buffer, size_t input_size, size_t thread_count);
+size_t lzkn64_compress_accurate_threaded(const u8 *input_buffer, u8 *output_buffer, size_t input_size, size_t thread_count);
+size_t lzkn64_compress_optimal_threaded(const u8 *input_buffer, u8 *output_buffer, size_t input_size, size_t thread_count);
+
+// Doesn't know how big the output buffer is, it has to be big enough for the decompressed data.
+// Returns 0 if the input is not a valid LZKN64 file.
 size_t lzkn64_decompress(const u8 *input_buffer, u8 *output_buffer, size_t input_size);
 
+// Returns false if the input is not a valid LZKN64 file or if the decompressed data doesn't fit into the output capacity.
+// The number of bytes read from the input and written to the output are stored in input_consumed and output_produced.
+bool lzkn64_decompress_checked(const u8 *input_buffer, size_t input_size, u8 *output_buffer, size_t output_capacity, size_t *input_consumed, size_t *output_produced);
+
+// Only reads the commands to find out how big the decompressed data is, without decompressing anything.
+// Returns false if the input is not a valid LZKN64 file.
+bool lzkn64_decompressed_size(const u8 *input_buffer, size_t input_size, size_t *decompressed_size);
+
+// The ring buffer of a stream has to hold the whole sliding window and the longest command.
+#define LZKN64_STREAM_MINIMUM_RING_SIZE (SLIDING_WINDOW_SIZE_EFFICIENT + RLE_LONG_MAXIMUM_LENGTH)
+
+typedef enum {
+    LZKN64_STREAM_STATUS_NEED_INPUT, // All input was consumed, call again with the next chunk.
+    LZKN64_STREAM_STATUS_OUTPUT_FULL, // The next command doesn't fit into the ring buffer, read some output first.
+    LZKN64_STREAM_STATUS_DONE,
+    LZKN64_STREAM_STATUS_ERROR
+} Lzkn64StreamStatus;
+
+// Decompresses a LZKN64 file that is passed in chunks of any size. The decompressed data is written into a ring buffer,
+// which also holds the sliding window, so only the ring buffer has to be kept in memory.
+typedef struct {
+    u8 *ring_buffer;
+    size_t ring_size;
+    size_t output_offset; // Number of bytes decompressed so far.
+    size_t read_offset; // Number of bytes taken out of the ring buffer so far.
+    size_t input_offset; // Number of bytes of the compressed file consumed so far, including the header.
+    size_t compressed_size;
+    u8 command[2]; // Bytes of a command that isn't complete yet.
+    size_t command_size;
+    size_t raw_copy_remaining;
+    Lzkn64StreamStatus status;
+} Lzkn64Stream;
+
+// Returns false if the ring buffer is smaller than LZKN64_STREAM_MINIMUM_RING_SIZE.
+bool lzkn64_stream_initialize(Lzkn64Stream *stream, u8 *ring_buffer, size_t ring_size);
+
+// Decompresses as much of the input chunk as possible. The number of bytes read from the chunk is stored in input_consumed,
+// bytes after the end of the compressed file (e.g. padding) are never consumed.
+Lzkn64StreamStatus lzkn64_stream_decompress(Lzkn64Stream *stream, const u8 *input_buffer, size_t input_size, size_t *input_consumed);
+
+// Moves up to output_size decompressed bytes out of the ring buffer, returns the number of bytes moved.
+size_t lzkn64_stream_read(Lzkn64Stream *stream, u8 *output_buffer, size_t output_size);
+
 #endif // LZKN64_H
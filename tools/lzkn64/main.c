@@ -6,7 +6,7 @@
 #include <string.h>
 
 bool parse_arguments(int argc, const char *argv[], struct Arguments *arguments) {
-    if (argc < 4) {
+    if (argc < 3) {
         return false;
     }
 
@@ -14,10 +14,22 @@ bool parse_arguments(int argc, const char *argv[], struct Arguments *arguments)
         arguments->mode = MODE_COMPRESS;
     } else if (strcmp(argv[1], "-d") == 0) {
         arguments->mode = MODE_DECOMPRESS;
+    } else if (strcmp(argv[1], "-s") == 0) {
+        arguments->mode = MODE_SIZE;
     } else {
         return false;
     }
 
+    if (arguments->mode == MODE_SIZE) {
+        // Only needs the input file.
+        arguments->input_file = argv[2];
+        return argc == 3;
+    }
+
+    if (argc < 4) {
+        return false;
+    }
+
     arguments->input_file = argv[2];
     arguments->output_file = argv[3];
 
@@ -26,8 +38,19 @@ bool parse_arguments(int argc, const char *argv[], struct Arguments *arguments)
             arguments->compression_type = COMPRESSION_TYPE_ACCURATE;
         } else if (strcmp(argv[i], "-e") == 0) {
             arguments->compression_type = COMPRESSION_TYPE_EFFICIENT;
+        } else if (strcmp(argv[i], "-o") == 0) {
+            arguments->compression_type = COMPRESSION_TYPE_OPTIMAL;
         } else if (strcmp(argv[i], "-p") == 0) {
             arguments->pad_output = true;
+        } else if (strcmp(argv[i], "-j") == 0 && (i + 1) < argc) {
+            char *end = NULL;
+            long thread_count = strtol(argv[++i], &end, 0);
+            if (end == argv[i] || *end != '\0' || thread_count < 1) {
+                printf("Error: The number of threads has to be at least 1.\n");
+                return false;
+            }
+
+            arguments->thread_count = thread_count;
         } else {
             return false;
         }
@@ -37,14 +60,18 @@ bool parse_arguments(int argc, const char *argv[], struct Arguments *arguments)
 }
 
 void print_help(void) {
-    printf("Usage: lzkn64 [-c|-d] <input_file> <output_file> [-a|-e] [-p]\n");
+    printf("Usage: lzkn64 [-c|-d] <input_file> <output_file> [-a|-e|-o] [-p] [-j <threads>]\n");
+    printf("       lzkn64 -s <input_file>\n");
     printf("Compress or decompress a file using lzkn64.\n");
     printf("\n");
     printf("  -c  Compress the input file.\n");
     printf("  -d  Decompress the input file.\n");
+    printf("  -s  Print the decompressed size of the input file without decompressing it.\n");
     printf("  -a  Use accurate compression (default).\n");
     printf("  -e  Use efficient compression.\n");
+    printf("  -o  Use optimal compression (smallest output, doesn't match the games).\n");
     printf("  -p  Pad the output file to the nearest 2-byte boundary.\n");
+    printf("  -j  Number of threads used to search for matches when compressing (default: 1).\n");
 }
 
 int main(int argc, const char *argv[]) {
@@ -54,6 +81,7 @@ int main(int argc, const char *argv[]) {
     arguments.output_file = NULL;
     arguments.compression_type = COMPRESSION_TYPE_ACCURATE;
     arguments.pad_output = false;
+    arguments.thread_count = 1;
 
     if (!parse_arguments(argc, argv, &arguments)) {
         print_help();
@@ -95,22 +123,53 @@ int main(int argc, const char *argv[]) {
         }
 
         if (arguments.compression_type == COMPRESSION_TYPE_ACCURATE) {
-            output_size = lzkn64_compress_accurate(input_buffer, output_buffer, input_size);
+            output_size = lzkn64_compress_accurate_threaded(input_buffer, output_buffer, input_size, arguments.thread_count);
         } else if (arguments.compression_type == COMPRESSION_TYPE_EFFICIENT) {
-            output_size = lzkn64_compress_efficient(input_buffer, output_buffer, input_size);
+            output_size = lzkn64_compress_efficient_threaded(input_buffer, output_buffer, input_size, arguments.thread_count);
+        } else if (arguments.compression_type == COMPRESSION_TYPE_OPTIMAL) {
+            output_size = lzkn64_compress_optimal_threaded(input_buffer, output_buffer, input_size, arguments.thread_count);
+        }
+
+        // Even an empty file has a header, the compressors only return 0 when they run out of memory.
+        if (output_size == 0) {
+            printf("Error: Could not allocate memory for compression.\n");
+            return EXIT_FAILURE;
         }
 
         if (arguments.pad_output) {
             output_size = (output_size + 1) & ~1;
         }
     } else if (arguments.mode == MODE_DECOMPRESS) {
-        // Allocate maximum possible size for decompressed file since we don't know the exact size yet.
-        output_buffer = malloc(LZKN64_MAXIMUM_FILE_SIZE);
+        size_t decompressed_size;
+        if (!lzkn64_decompressed_size(input_buffer, input_size, &decompressed_size)) {
+            printf("Error: Input file is not a valid LZKN64 file.\n");
+            return EXIT_FAILURE;
+        }
+
+        // The exact size is known up front, allocate at least one byte so an empty file still gets a buffer.
+        output_buffer = malloc(decompressed_size > 0 ? decompressed_size : 1);
         if (output_buffer == NULL) {
             printf("Error: Could not allocate memory for output buffer.\n");
             return EXIT_FAILURE;
         }
-        output_size = lzkn64_decompress(input_buffer, output_buffer, input_size);
+
+        size_t input_consumed;
+        if (!lzkn64_decompress_checked(input_buffer, input_size, output_buffer, decompressed_size, &input_consumed, &output_size)) {
+            printf("Error: Input file is not a valid LZKN64 file.\n");
+            return EXIT_FAILURE;
+        }
+    } else if (arguments.mode == MODE_SIZE) {
+        size_t decompressed_size;
+        if (!lzkn64_decompressed_size(input_buffer, input_size, &decompressed_size)) {
+            printf("Error: Input file is not a valid LZKN64 file.\n");
+            return EXIT_FAILURE;
+        }
+
+        printf("%zu\n", decompressed_size);
+
+        free(input_buffer);
+
+        return EXIT_SUCCESS;
     } else {
         printf("Error: Invalid mode.\n");
         return EXIT_FAILURE;
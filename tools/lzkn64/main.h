@@ -8,12 +8,14 @@
 enum Mode {
     MODE_UNDEFINED,
     MODE_COMPRESS,
-    MODE_DECOMPRESS
+    MODE_DECOMPRESS,
+    MODE_SIZE
 };
 
 enum CompressionType {
     COMPRESSION_TYPE_ACCURATE,
     COMPRESSION_TYPE_EFFICIENT,
+    COMPRESSION_TYPE_OPTIMAL,
 };
 
 struct Arguments {
@@ -22,6 +24,7 @@ struct Arguments {
     const char *output_file;
     enum CompressionType compression_type;
     bool pad_output;
+    size_t thread_count;
 };
 
 bool parse_arguments(int argc, const char *argv[], struct Arguments *arguments);
@@ -0,0 +1,284 @@
+#include "lzkn64.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Checks that the streaming decoder gives the same bytes as lzkn64_decompress, however the input is split into chunks,
+// however the output is read and whatever the size of the ring buffer is.
+
+enum SplitMode {
+    SPLIT_MODE_WHOLE, // The whole file in one chunk.
+    SPLIT_MODE_SINGLE_BYTES, // Every byte in a chunk of its own.
+    SPLIT_MODE_SMALL, // Chunks of 1 to 8 bytes.
+    SPLIT_MODE_LARGE, // Chunks of 1 to 4096 bytes.
+    SPLIT_MODE_COMMAND_HEADERS, // A chunk ends in the middle of the header and of every two byte command.
+    SPLIT_MODE_COUNT
+};
+
+static const char *split_mode_names[SPLIT_MODE_COUNT] = {
+    "whole",
+    "single bytes",
+    "small",
+    "large",
+    "command headers"
+};
+
+static u64 random_state = 0x853C49E6748FEA9B;
+
+static u32 random_next(void) {
+    // xorshift64*, the same numbers on every platform so failures can be repeated with the same seed.
+    random_state ^= random_state >> 12;
+    random_state ^= random_state << 25;
+    random_state ^= random_state >> 27;
+
+    return (u32)((random_state * 0x2545F4914F6CDD1D) >> 32);
+}
+
+static size_t random_range(size_t minimum, size_t maximum) {
+    return minimum + (random_next() % (maximum - minimum + 1));
+}
+
+static void generate_input(u8 *buffer, size_t size) {
+    // Pieces of random bytes, repeated patterns, runs of any value and long runs of zeros, so every command is used.
+    size_t offset = 0;
+
+    while (offset < size) {
+        // Lengths around the limits of the commands come up much more often than they would by chance.
+        static const size_t limit_lengths[] = { 1, 2, 3, 31, 32, 33, 34, 35, 256, 257, 258, 259 };
+        size_t length = (random_next() % 3) == 0 ? limit_lengths[random_next() % (sizeof(limit_lengths) / sizeof(limit_lengths[0]))] : random_range(1, 600);
+        if (length > (size - offset)) {
+            length = size - offset;
+        }
+
+        switch (random_next() % 4) {
+            case 0:
+                for (size_t i = 0; i < length; i++) {
+                    buffer[offset + i] = (u8)random_next();
+                }
+                break;
+            case 1: {
+                size_t period = random_range(1, 40);
+                for (size_t i = 0; i < length; i++) {
+                    buffer[offset + i] = i < period ? (u8)random_next() : buffer[offset + i - period];
+                }
+                break;
+            }
+            case 2:
+                memset(buffer + offset, (u8)random_next(), length);
+                break;
+            default:
+                memset(buffer + offset, 0, length);
+                break;
+        }
+
+        offset += length;
+    }
+}
+
+// Runs of zeros of the lengths around the limits of the commands, each after more random bytes than the sliding window
+// holds, so they are written as runs and not copied from an earlier run. Returns the size.
+static size_t generate_zero_runs(u8 *buffer) {
+    static const size_t run_lengths[] = { 2, 3, 31, 32, 33, 34, 35, 256, 257, 258, 259, 291 };
+    size_t size = 0;
+
+    for (size_t run = 0; run < sizeof(run_lengths) / sizeof(run_lengths[0]); run++) {
+        for (size_t i = 0; i < SLIDING_WINDOW_SIZE_EFFICIENT + 1; i++) {
+            buffer[size++] = (u8)(random_next() | 1);
+        }
+
+        memset(buffer + size, 0, run_lengths[run]);
+        size += run_lengths[run];
+    }
+
+    return size;
+}
+
+// Returns the offsets where the chunks of a split mode end.
+// The last chunk also has the bytes after the end of the file.
+static size_t get_split_offsets(enum SplitMode split_mode, const u8 *compressed_buffer, size_t file_size, size_t compressed_size, size_t *offsets) {
+    size_t count = 0;
+
+    if (split_mode == SPLIT_MODE_COMMAND_HEADERS) {
+        offsets[count++] = 2;
+        size_t offset = 4;
+
+        while (offset < file_size) {
+            u8 command = compressed_buffer[offset];
+
+            if (command >= COMMAND_RAW_COPY_START && command <= COMMAND_RAW_COPY_END) {
+                offset += 1 + (command & COMMAND_RAW_COPY_LENGTH_MASK);
+            } else if (command >= COMMAND_RLE_WRITE_SHORT_ZERO_START && command <= COMMAND_RLE_WRITE_SHORT_ZERO_END) {
+                offset += 1;
+            } else {
+                offsets[count++] = offset + 1;
+                offset += 2;
+            }
+        }
+    } else {
+        size_t offset = 0;
+
+        while (offset < compressed_size) {
+            if (split_mode == SPLIT_MODE_WHOLE) {
+                offset = compressed_size;
+            } else if (split_mode == SPLIT_MODE_SINGLE_BYTES) {
+                offset += 1;
+            } else if (split_mode == SPLIT_MODE_SMALL) {
+                offset += random_range(1, 8);
+            } else {
+                offset += random_range(1, 4096);
+            }
+
+            offsets[count++] = offset < compressed_size ? offset : compressed_size;
+        }
+    }
+
+    offsets[count++] = compressed_size;
+
+    return count;
+}
+
+// Reads a random amount of the decompressed data, or all of it. Returns false if there is more than expected.
+static bool read_output(Lzkn64Stream *stream, u8 *output_buffer, size_t expected_size, size_t *output_size, bool is_everything) {
+    // One byte more than expected fits into the output buffer, to notice any extra output.
+    size_t length = (expected_size - *output_size) + 1;
+
+    if (!is_everything && length > 1) {
+        length = random_range(1, length < 300 ? length : 300);
+    }
+
+    *output_size += lzkn64_stream_read(stream, output_buffer + *output_size, length);
+
+    return *output_size <= expected_size;
+}
+
+static bool test_stream(const u8 *compressed_buffer, size_t compressed_size, const u8 *expected_buffer, size_t expected_size, size_t ring_size, enum SplitMode split_mode, u8 *output_buffer, size_t *split_offsets) {
+    u8 *ring_buffer = malloc(ring_size);
+    if (ring_buffer == NULL) {
+        printf("Error: Could not allocate memory for the ring buffer.\n");
+        return false;
+    }
+
+    Lzkn64Stream stream;
+    if (!lzkn64_stream_initialize(&stream, ring_buffer, ring_size)) {
+        printf("Error: A ring buffer of 0x%zX bytes was rejected.\n", ring_size);
+        free(ring_buffer);
+        return false;
+    }
+
+    // The compressed data is followed by a padding byte, which the stream must not consume.
+    size_t file_size = compressed_size - 1;
+    size_t split_count = get_split_offsets(split_mode, compressed_buffer, file_size, compressed_size, split_offsets);
+    size_t input_offset = 0;
+    size_t output_size = 0;
+    Lzkn64StreamStatus status = LZKN64_STREAM_STATUS_NEED_INPUT;
+    const char *error = NULL;
+
+    for (size_t split = 0; split < split_count && status != LZKN64_STREAM_STATUS_DONE && error == NULL; split++) {
+        size_t chunk_end = split_offsets[split];
+
+        while (error == NULL) {
+            size_t input_consumed;
+            status = lzkn64_stream_decompress(&stream, compressed_buffer + input_offset, chunk_end - input_offset, &input_consumed);
+            input_offset += input_consumed;
+
+            if (!read_output(&stream, output_buffer, expected_size, &output_size, status == LZKN64_STREAM_STATUS_DONE)) {
+                error = "more output than lzkn64_decompress";
+            } else if (status == LZKN64_STREAM_STATUS_ERROR) {
+                error = "the stream reported an error";
+            } else if (status == LZKN64_STREAM_STATUS_NEED_INPUT && input_offset != chunk_end) {
+                error = "the stream needs input without consuming the chunk";
+            } else if (status != LZKN64_STREAM_STATUS_OUTPUT_FULL) {
+                break;
+            }
+        }
+    }
+
+    if (error == NULL && status != LZKN64_STREAM_STATUS_DONE) {
+        error = "the stream didn't finish";
+    } else if (error == NULL && input_offset != file_size) {
+        error = "the stream consumed a different number of bytes than the file has";
+    } else if (error == NULL && (output_size != expected_size || memcmp(output_buffer, expected_buffer, expected_size) != 0)) {
+        error = "the output differs from lzkn64_decompress";
+    }
+
+    if (error != NULL) {
+        printf("Error: Ring buffer 0x%zX, %s chunks: %s (input 0x%zX of 0x%zX, output 0x%zX of 0x%zX).\n", ring_size, split_mode_names[split_mode], error, input_offset, file_size, output_size, expected_size);
+    }
+
+    free(ring_buffer);
+
+    return error == NULL;
+}
+
+int main(int argc, const char *argv[]) {
+    if (argc > 1) {
+        random_state = strtoull(argv[1], NULL, 0) | 1;
+    }
+
+    static const size_t input_sizes[] = { 0, 1, 2, 35, 1000, 5000, 40000 };
+    const size_t ring_sizes[] = { LZKN64_STREAM_MINIMUM_RING_SIZE, LZKN64_STREAM_MINIMUM_RING_SIZE + 1, LZKN64_STREAM_MINIMUM_RING_SIZE + 0x1F, 0x1000, 0x10000 };
+    size_t (*compressors[])(const u8 *, u8 *, size_t) = { lzkn64_compress_accurate, lzkn64_compress_efficient, lzkn64_compress_optimal };
+    static const char *compressor_names[] = { "accurate", "efficient", "optimal" };
+
+    size_t maximum_size = input_sizes[(sizeof(input_sizes) / sizeof(input_sizes[0])) - 1];
+    u8 *input_buffer = malloc(maximum_size);
+    u8 *compressed_buffer = malloc(LZKN64_COMPRESS_BOUND(maximum_size) + 1);
+    u8 *expected_buffer = malloc(maximum_size + 1);
+    u8 *output_buffer = malloc(maximum_size + 1);
+    size_t *split_offsets = malloc((LZKN64_COMPRESS_BOUND(maximum_size) + 2) * sizeof(size_t));
+    if (input_buffer == NULL || compressed_buffer == NULL || expected_buffer == NULL || output_buffer == NULL || split_offsets == NULL) {
+        printf("Error: Could not allocate memory for test buffers.\n");
+        return EXIT_FAILURE;
+    }
+
+    size_t test_count = 0;
+    size_t failure_count = 0;
+
+    // After the inputs of every size comes the one with runs of zeros.
+    for (size_t size_index = 0; size_index <= sizeof(input_sizes) / sizeof(input_sizes[0]); size_index++) {
+        size_t input_size;
+
+        if (size_index < sizeof(input_sizes) / sizeof(input_sizes[0])) {
+            input_size = input_sizes[size_index];
+            generate_input(input_buffer, input_size);
+        } else {
+            input_size = generate_zero_runs(input_buffer);
+        }
+
+        for (size_t compressor = 0; compressor < sizeof(compressors) / sizeof(compressors[0]); compressor++) {
+            size_t compressed_size = compressors[compressor](input_buffer, compressed_buffer, input_size);
+
+            // The padding byte after the file, like between the files of a ROM.
+            compressed_buffer[compressed_size++] = 0xA5;
+
+            size_t expected_size = lzkn64_decompress(compressed_buffer, expected_buffer, compressed_size);
+            if (expected_size != input_size || memcmp(expected_buffer, input_buffer, input_size) != 0) {
+                printf("Error: %s compression of 0x%zX bytes doesn't decompress to the input.\n", compressor_names[compressor], input_size);
+                failure_count++;
+                continue;
+            }
+
+            for (size_t ring_index = 0; ring_index < sizeof(ring_sizes) / sizeof(ring_sizes[0]); ring_index++) {
+                for (size_t split_mode = 0; split_mode < SPLIT_MODE_COUNT; split_mode++) {
+                    test_count++;
+
+                    if (!test_stream(compressed_buffer, compressed_size, expected_buffer, expected_size, ring_sizes[ring_index], split_mode, output_buffer, split_offsets)) {
+                        printf("       %s compression of 0x%zX bytes.\n", compressor_names[compressor], input_size);
+                        failure_count++;
+                    }
+                }
+            }
+        }
+    }
+
+    printf("%zu of %zu stream tests passed.\n", test_count - failure_count, test_count);
+
+    free(input_buffer);
+    free(compressed_buffer);
+    free(expected_buffer);
+    free(output_buffer);
+    free(split_offsets);
+
+    return failure_count == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,252 @@
+/* snesrc - SNES Recompiler
+ *
+ * Mar 23, 2010: addition by spinout to actually fix CRC if it is incorrect
+ *
+ * Copyright notice for this file:
+ *  Copyright (C) 2005 Parasyte
+ *
+ * Based on uCON64's N64 checksum algorithm by Andreas Sterbenz
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "n64crc.h"
+
+#define ROM_READ_SIZE (CHECKSUM_START + CHECKSUM_LENGTH)
+
+enum {
+	ROM_OK,
+	ROM_FIXED,
+	ROM_MISMATCH,
+	ROM_OPEN_FAILED,
+	ROM_ALLOCATE_FAILED,
+	ROM_READ_FAILED,
+	ROM_CRC_FAILED,
+	ROM_WRITE_FAILED
+};
+
+typedef struct {
+	const char *path;
+	int status;
+	unsigned int crc[2];
+	unsigned int header_crc[2];
+} Rom;
+
+//Every thread takes the next ROM nobody has started yet
+typedef struct {
+	Rom *roms;
+	int rom_count;
+	int next_rom;
+	int check;
+	pthread_mutex_t mutex;
+} Task;
+
+static void processRom(Rom *rom, unsigned char *buffer, int check) {
+	FILE *fin;
+
+	if (!buffer) {
+		rom->status = ROM_ALLOCATE_FAILED;
+		return;
+	}
+
+	//Open file
+	if (!(fin = fopen(rom->path, check ? "rb" : "r+b"))) {
+		rom->status = ROM_OPEN_FAILED;
+		return;
+	}
+
+	//Read data
+	if (fread(buffer, 1, ROM_READ_SIZE, fin) != ROM_READ_SIZE) {
+		rom->status = ROM_READ_FAILED;
+		fclose(fin);
+		return;
+	}
+
+	//Calculate CRC
+	if (N64CalcCRC(rom->crc, buffer)) {
+		rom->status = ROM_CRC_FAILED;
+		fclose(fin);
+		return;
+	}
+
+	rom->header_crc[0] = (unsigned int)BYTES2LONG(&buffer[N64_CRC1]);
+	rom->header_crc[1] = (unsigned int)BYTES2LONG(&buffer[N64_CRC2]);
+	rom->status = ROM_OK;
+
+	if (rom->crc[0] == rom->header_crc[0] && rom->crc[1] == rom->header_crc[1]) {
+		fclose(fin);
+		return;
+	}
+
+	if (check) {
+		rom->status = ROM_MISMATCH;
+		fclose(fin);
+		return;
+	}
+
+	rom->status = ROM_FIXED;
+
+	if (rom->crc[0] != rom->header_crc[0]) {
+		Write32(buffer, N64_CRC1, rom->crc[0]);
+		fseek(fin, N64_CRC1, SEEK_SET);
+		if (fwrite(&buffer[N64_CRC1], 1, 4, fin) != 4) rom->status = ROM_WRITE_FAILED;
+	}
+
+	if (rom->crc[1] != rom->header_crc[1]) {
+		Write32(buffer, N64_CRC2, rom->crc[1]);
+		fseek(fin, N64_CRC2, SEEK_SET);
+		if (fwrite(&buffer[N64_CRC2], 1, 4, fin) != 4) rom->status = ROM_WRITE_FAILED;
+	}
+
+	if (fclose(fin) != 0) rom->status = ROM_WRITE_FAILED;
+}
+
+static void *processRoms(void *argument) {
+	Task *task = argument;
+	int index;
+
+	//Allocate memory once per thread
+	unsigned char *buffer = (unsigned char*)malloc(ROM_READ_SIZE);
+
+	for (;;) {
+		pthread_mutex_lock(&task->mutex);
+		index = task->next_rom++;
+		pthread_mutex_unlock(&task->mutex);
+
+		if (index >= task->rom_count) break;
+
+		processRom(&task->roms[index], buffer, task->check);
+	}
+
+	free(buffer);
+
+	return NULL;
+}
+
+static void printUsage(void) {
+	printf("Usage: n64sums [--check] [-j <threads>] <infile> [<infile> ...]\n");
+	printf("Fixes the CRC in the header of every file, or only reports the files with a wrong CRC with --check.\n");
+	printf("The files are processed on -j threads (default: number of processors).\n");
+}
+
+int main(int argc, char **argv) {
+	Task task;
+	Rom *roms;
+	pthread_t *threads;
+	int *thread_started;
+	int thread_count = 0, rom_count = 0, failed_count = 0;
+	int i;
+
+	//Check args
+	if (!(roms = (Rom*)calloc(argc, sizeof(Rom)))) {
+		printf("Unable to allocate memory\n");
+		return 1;
+	}
+
+	task.check = 0;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--check") == 0) {
+			task.check = 1;
+		}
+		else if (strcmp(argv[i], "-j") == 0 && (i + 1) < argc) {
+			thread_count = atoi(argv[++i]);
+		}
+		else {
+			roms[rom_count++].path = argv[i];
+		}
+	}
+
+	if (rom_count == 0) {
+		printUsage();
+		free(roms);
+		return 1;
+	}
+
+	if (thread_count <= 0) thread_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (thread_count <= 0) thread_count = 1;
+	if (thread_count > rom_count) thread_count = rom_count;
+
+	task.roms = roms;
+	task.rom_count = rom_count;
+	task.next_rom = 0;
+	pthread_mutex_init(&task.mutex, NULL);
+
+	//The calling thread works on the files as well
+	threads = (pthread_t*)calloc(thread_count, sizeof(pthread_t));
+	thread_started = (int*)calloc(thread_count, sizeof(int));
+
+	for (i = 1; i < thread_count && threads && thread_started; i++) {
+		thread_started[i] = pthread_create(&threads[i], NULL, processRoms, &task) == 0;
+	}
+
+	processRoms(&task);
+
+	for (i = 1; i < thread_count && threads && thread_started; i++) {
+		if (thread_started[i]) pthread_join(threads[i], NULL);
+	}
+
+	pthread_mutex_destroy(&task.mutex);
+	free(threads);
+	free(thread_started);
+
+	//Report in the order the files were given
+	for (i = 0; i < rom_count; i++) {
+		Rom *rom = &roms[i];
+
+		switch (rom->status) {
+			case ROM_OK:
+				if (task.check) printf("%s: OK\n", rom->path);
+				break;
+			case ROM_FIXED:
+				break;
+			case ROM_MISMATCH:
+				printf("%s: CRC mismatch (header %08X %08X, calculated %08X %08X)\n", rom->path, rom->header_crc[0], rom->header_crc[1], rom->crc[0], rom->crc[1]);
+				failed_count++;
+				break;
+			case ROM_OPEN_FAILED:
+				printf("Unable to open \"%s\" in mode \"%s\"\n", rom->path, task.check ? "rb" : "r+b");
+				failed_count++;
+				break;
+			case ROM_ALLOCATE_FAILED:
+				printf("%s: Unable to allocate %d bytes of memory\n", rom->path, ROM_READ_SIZE);
+				failed_count++;
+				break;
+			case ROM_READ_FAILED:
+				printf("%s: Unable to read %d bytes of data (invalid N64 image?)\n", rom->path, ROM_READ_SIZE);
+				failed_count++;
+				break;
+			case ROM_CRC_FAILED:
+				printf("%s: Unable to calculate CRC\n", rom->path);
+				failed_count++;
+				break;
+			case ROM_WRITE_FAILED:
+				printf("%s: Unable to write CRC\n", rom->path);
+				failed_count++;
+				break;
+		}
+	}
+
+	free(roms);
+
+	return failed_count ? 1 : 0;
+}
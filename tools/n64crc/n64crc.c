@@ -23,37 +23,16 @@
  */
 
 
-#include <stdio.h>
-#include <stdlib.h>
+#include "n64crc.h"
 
-#define ROL(i, b) (((i) << (b)) | ((i) >> (32 - (b))))
-#define BYTES2LONG(b) ( (b)[0] << 24 | \
-                        (b)[1] << 16 | \
-                        (b)[2] <<  8 | \
-                        (b)[3] )
+#include <pthread.h>
+#include <string.h>
 
-#define N64_HEADER_SIZE  0x40
-#define N64_BC_SIZE      (0x1000 - N64_HEADER_SIZE)
+//Slicing-by-8: crc_table[0] is the usual byte table, crc_table[k] advances a byte by k more bytes of zeros
+static unsigned int crc_table[8][256];
+static pthread_once_t crc_table_once = PTHREAD_ONCE_INIT;
 
-#define N64_CRC1         0x10
-#define N64_CRC2         0x14
-
-#define CHECKSUM_START   0x00001000
-#define CHECKSUM_LENGTH  0x00100000
-#define CHECKSUM_CIC6102 0xF8CA4DDC
-#define CHECKSUM_CIC6103 0xA3886759
-#define CHECKSUM_CIC6105 0xDF26F436
-#define CHECKSUM_CIC6106 0x1FEA617A
-
-#define Write32(Buffer, Offset, Value)\
-	Buffer[Offset] = (Value & 0xFF000000) >> 24;\
-	Buffer[Offset + 1] = (Value & 0x00FF0000) >> 16;\
-	Buffer[Offset + 2] = (Value & 0x0000FF00) >> 8;\
-	Buffer[Offset + 3] = (Value & 0x000000FF);\
-
-unsigned int crc_table[256];
-
-void gen_table() {
+static void gen_table(void) {
 	unsigned int crc, poly;
 	int	i, j;
 
@@ -64,23 +43,66 @@ void gen_table() {
 			if (crc & 1) crc = (crc >> 1) ^ poly;
 			else crc >>= 1;
 		}
-		crc_table[i] = crc;
+		crc_table[0][i] = crc;
+	}
+
+	for (i = 0; i < 256; i++) {
+		for (j = 1; j < 8; j++) {
+			crc_table[j][i] = (crc_table[j - 1][i] >> 8) ^ crc_table[0][crc_table[j - 1][i] & 0xFF];
+		}
 	}
 }
 
-unsigned int crc32(unsigned char *data, int len) {
+static unsigned int load_le32(const unsigned char *b) {
+	return (unsigned int)b[0] | (unsigned int)b[1] << 8 | (unsigned int)b[2] << 16 | (unsigned int)b[3] << 24;
+}
+
+//One load per 8 bytes instead of one per byte, the compiler turns the swap into a single instruction
+static unsigned long long load_be64(const unsigned char *b) {
+	unsigned long long value;
+
+	memcpy(&value, b, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	value = __builtin_bswap64(value);
+#endif
+
+	return value;
+}
+
+static unsigned int load_be32(const unsigned char *b) {
+	unsigned int value;
+
+	memcpy(&value, b, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	value = __builtin_bswap32(value);
+#endif
+
+	return value;
+}
+
+static unsigned int crc32(const unsigned char *data, int len) {
 	unsigned int crc = ~0;
-	int i;
+	unsigned int one, two;
+	int i = 0;
+
+	pthread_once(&crc_table_once, gen_table);
+
+	for (; i + 8 <= len; i += 8) {
+		one = load_le32(&data[i]) ^ crc;
+		two = load_le32(&data[i + 4]);
+		crc = crc_table[7][one & 0xFF] ^ crc_table[6][(one >> 8) & 0xFF] ^ crc_table[5][(one >> 16) & 0xFF] ^ crc_table[4][one >> 24] ^
+			  crc_table[3][two & 0xFF] ^ crc_table[2][(two >> 8) & 0xFF] ^ crc_table[1][(two >> 16) & 0xFF] ^ crc_table[0][two >> 24];
+	}
 
-	for (i = 0; i < len; i++) {
-		crc = (crc >> 8) ^ crc_table[(crc ^ data[i]) & 0xFF];
+	for (; i < len; i++) {
+		crc = (crc >> 8) ^ crc_table[0][(crc ^ data[i]) & 0xFF];
 	}
 
 	return ~crc;
 }
 
 
-int N64GetCIC(unsigned char *data) {
+int N64GetCIC(const unsigned char *data) {
 	switch (crc32(&data[N64_HEADER_SIZE], N64_BC_SIZE)) {
 		case 0x6170A4A1: return 6101;
 		case 0x90BB6CB5: return 6102;
@@ -92,13 +114,14 @@ int N64GetCIC(unsigned char *data) {
 	return 6105;
 }
 
-int N64CalcCRC(unsigned int *crc, unsigned char *data) {
+int N64CalcCRC(unsigned int *crc, const unsigned char *data) {
 	int bootcode, i;
 	unsigned int seed;
 
 	unsigned int t1, t2, t3;
 	unsigned int t4, t5, t6;
 	unsigned int r, d;
+	unsigned long long pair;
 
 
 	switch ((bootcode = N64GetCIC(data))) {
@@ -121,22 +144,31 @@ int N64CalcCRC(unsigned int *crc, unsigned char *data) {
 
 	t1 = t2 = t3 = t4 = t5 = t6 = seed;
 
+#define CHECKSUM_STEP(word, offset) \
+		d = (word); \
+		if ((t6 + d) < t6) t4++; \
+		t6 += d; \
+		t3 ^= d; \
+		r = ROL(d, (d & 0x1F)); \
+		t5 += r; \
+		if (t2 > d) t2 ^= r; \
+		else t2 ^= t6 ^ d; \
+		if (bootcode == 6105) t1 += load_be32(&data[N64_HEADER_SIZE + 0x0710 + ((offset) & 0xFF)]) ^ d; \
+		else t1 += t5 ^ d;
+
+	//Two words per load
 	i = CHECKSUM_START;
 	while (i < (CHECKSUM_START + CHECKSUM_LENGTH)) {
-		d = BYTES2LONG(&data[i]);
-		if ((t6 + d) < t6) t4++;
-		t6 += d;
-		t3 ^= d;
-		r = ROL(d, (d & 0x1F));
-		t5 += r;
-		if (t2 > d) t2 ^= r;
-		else t2 ^= t6 ^ d;
-
-		if (bootcode == 6105) t1 += BYTES2LONG(&data[N64_HEADER_SIZE + 0x0710 + (i & 0xFF)]) ^ d;
-		else t1 += t5 ^ d;
+		pair = load_be64(&data[i]);
 
-		i += 4;
+		CHECKSUM_STEP((unsigned int)(pair >> 32), i);
+		CHECKSUM_STEP((unsigned int)pair, i + 4);
+
+		i += 8;
 	}
+
+#undef CHECKSUM_STEP
+
 	if (bootcode == 6103) {
 		crc[0] = (t6 ^ t4) + t3;
 		crc[1] = (t5 ^ t2) + t1;
@@ -153,61 +185,14 @@ int N64CalcCRC(unsigned int *crc, unsigned char *data) {
 	return 0;
 }
 
-int main(int argc, char **argv) {
-	FILE *fin;
+int N64FixCRC(unsigned char *data, size_t size) {
 	unsigned int crc[2];
-	unsigned char *buffer;
-
-	//Init CRC algorithm
-	gen_table();
-
-	//Check args
-	if (argc != 2) {
-		printf("Usage: n64sums <infile>\n");
-		return 1;
-	}
-
-	//Open file
-	if (!(fin = fopen(argv[1], "r+b"))) {
-		printf("Unable to open \"%s\" in mode \"%s\"\n", argv[1], "r+b");
-		return 1;
-	}
 
-	//Allocate memory
-	if (!(buffer = (unsigned char*)malloc((CHECKSUM_START + CHECKSUM_LENGTH)))) {
-		printf("Unable to allocate %d bytes of memory\n", (CHECKSUM_START + CHECKSUM_LENGTH));
-		fclose(fin);
-		return 1;
-	}
-
-	//Read data
-	if (fread(buffer, 1, (CHECKSUM_START + CHECKSUM_LENGTH), fin) != (CHECKSUM_START + CHECKSUM_LENGTH)) {
-		printf("Unable to read %d bytes of data (invalid N64 image?)\n", (CHECKSUM_START + CHECKSUM_LENGTH));
-		fclose(fin);
-		free(buffer);
-		return 1;
-	}
-
-	//Calculate CRC
-	if (N64CalcCRC(crc, buffer)) {
-		printf("Unable to calculate CRC\n");
-	}
-	else {
-		if (crc[0] != (unsigned int)BYTES2LONG(&buffer[N64_CRC1])) {
-			Write32(buffer, N64_CRC1, crc[0]);
-			fseek(fin, N64_CRC1, SEEK_SET);
-			fwrite(&buffer[N64_CRC1], 1, 4, fin);
-		}
-
-		if (crc[1] != (unsigned int)BYTES2LONG(&buffer[N64_CRC2])) {
-			Write32(buffer, N64_CRC2, crc[1]);
-			fseek(fin, N64_CRC2, SEEK_SET);
-			fwrite(&buffer[N64_CRC2], 1, 4, fin);
-		}
-	}
+	if (size < (CHECKSUM_START + CHECKSUM_LENGTH)) return 1;
+	if (N64CalcCRC(crc, data)) return 1;
 
-	fclose(fin);
-	free(buffer);
+	Write32(data, N64_CRC1, crc[0]);
+	Write32(data, N64_CRC2, crc[1]);
 
 	return 0;
 }
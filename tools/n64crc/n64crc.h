@@ -0,0 +1,67 @@
+/* snesrc - SNES Recompiler
+ *
+ * Mar 23, 2010: addition by spinout to actually fix CRC if it is incorrect
+ *
+ * Copyright notice for this file:
+ *  Copyright (C) 2005 Parasyte
+ *
+ * Based on uCON64's N64 checksum algorithm by Andreas Sterbenz
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef N64CRC_H
+#define N64CRC_H
+
+#include <stddef.h>
+
+#define ROL(i, b) (((i) << (b)) | ((i) >> (32 - (b))))
+#define BYTES2LONG(b) ( (b)[0] << 24 | \
+                        (b)[1] << 16 | \
+                        (b)[2] <<  8 | \
+                        (b)[3] )
+
+#define N64_HEADER_SIZE  0x40
+#define N64_BC_SIZE      (0x1000 - N64_HEADER_SIZE)
+
+#define N64_CRC1         0x10
+#define N64_CRC2         0x14
+
+#define CHECKSUM_START   0x00001000
+#define CHECKSUM_LENGTH  0x00100000
+#define CHECKSUM_CIC6102 0xF8CA4DDC
+#define CHECKSUM_CIC6103 0xA3886759
+#define CHECKSUM_CIC6105 0xDF26F436
+#define CHECKSUM_CIC6106 0x1FEA617A
+
+#define Write32(Buffer, Offset, Value)\
+	Buffer[Offset] = (Value & 0xFF000000) >> 24;\
+	Buffer[Offset + 1] = (Value & 0x00FF0000) >> 16;\
+	Buffer[Offset + 2] = (Value & 0x0000FF00) >> 8;\
+	Buffer[Offset + 3] = (Value & 0x000000FF);\
+
+// Detects the CIC from the bootcode, data has to hold at least the first 0x1000 bytes of the ROM.
+int N64GetCIC(const unsigned char *data);
+
+// Calculates both CRCs of the ROM header, data has to hold at least CHECKSUM_START + CHECKSUM_LENGTH bytes.
+// Returns non-zero if the CIC isn't supported.
+int N64CalcCRC(unsigned int *crc, const unsigned char *data);
+
+// Calculates the CRCs and writes them into the header of the ROM in memory.
+// Returns non-zero if the ROM is too small or the CIC isn't supported.
+int N64FixCRC(unsigned char *data, size_t size);
+
+#endif // N64CRC_H
@@ -0,0 +1,181 @@
+#include "cache.h"
+#include "file.h"
+#include "../lzkn64/lzkn64.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+// Has to be increased whenever the compressors change their output, so old files are never used.
+#define CACHE_VERSION 2
+#define CACHE_FILE_EXTENSION ".lzkn64"
+
+typedef struct {
+    char* path;
+    size_t size;
+    time_t access_time;
+} CacheFile;
+
+static const char* cache_compression_type_name(CompressionType compression_type) {
+    if (compression_type == COMPRESSION_TYPE_EFFICIENT) {
+        return "efficient";
+    } else if (compression_type == COMPRESSION_TYPE_OPTIMAL) {
+        return "optimal";
+    }
+
+    return "accurate";
+}
+
+static void cache_get_path(const CompressionCache* cache, u64 uncompressed_hash, size_t uncompressed_size, CompressionType compression_type, char* path, size_t path_size) {
+    snprintf(path, path_size, "%s/v%d-%s-%016llX-%08zX" CACHE_FILE_EXTENSION, cache->directory, CACHE_VERSION, cache_compression_type_name(compression_type), (unsigned long long)uncompressed_hash, uncompressed_size);
+}
+
+bool cache_initialize(const CompressionCache* cache) {
+    return file_create_directory(cache->directory);
+}
+
+bool cache_load(const CompressionCache* cache, const u8* uncompressed_buffer, size_t uncompressed_size, u64 uncompressed_hash, CompressionType compression_type, u8* compressed_buffer, size_t compressed_capacity, size_t* compressed_size, u8* scratch_buffer) {
+    char path[4096];
+    cache_get_path(cache, uncompressed_hash, uncompressed_size, compression_type, path, sizeof(path));
+
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    if (file_size <= 0 || (size_t)file_size > compressed_capacity || fread(compressed_buffer, 1, file_size, file) != (size_t)file_size) {
+        fclose(file);
+        return false;
+    }
+
+    fclose(file);
+
+    size_t input_consumed;
+    size_t output_produced;
+    if (!lzkn64_decompress_checked(compressed_buffer, file_size, scratch_buffer, uncompressed_size, &input_consumed, &output_produced) || output_produced != uncompressed_size || memcmp(scratch_buffer, uncompressed_buffer, uncompressed_size) != 0) {
+        return false;
+    }
+
+    // Mark the file as recently used so it's trimmed last.
+    utime(path, NULL);
+
+    *compressed_size = file_size;
+
+    return true;
+}
+
+void cache_store(const CompressionCache* cache, size_t uncompressed_size, u64 uncompressed_hash, CompressionType compression_type, const u8* compressed_buffer, size_t compressed_size) {
+    char path[4096];
+    cache_get_path(cache, uncompressed_hash, uncompressed_size, compression_type, path, sizeof(path));
+
+    // Write to a temporary file first and rename it, so other processes never see a partially written file.
+    char temporary_path[4096 + 16];
+    snprintf(temporary_path, sizeof(temporary_path), "%s.XXXXXX", path);
+
+    int file_descriptor = mkstemp(temporary_path);
+    if (file_descriptor < 0) {
+        return;
+    }
+
+    FILE* file = fdopen(file_descriptor, "wb");
+    if (file == NULL) {
+        close(file_descriptor);
+        unlink(temporary_path);
+        return;
+    }
+
+    bool success = fwrite(compressed_buffer, 1, compressed_size, file) == compressed_size;
+    success = (fclose(file) == 0) && success;
+
+    if (!success || rename(temporary_path, path) != 0) {
+        unlink(temporary_path);
+    }
+}
+
+static int compare_cache_files(const void* a, const void* b) {
+    const CacheFile* file_a = a;
+    const CacheFile* file_b = b;
+
+    if (file_a->access_time != file_b->access_time) {
+        return file_a->access_time < file_b->access_time ? -1 : 1;
+    }
+
+    return strcmp(file_a->path, file_b->path);
+}
+
+void cache_trim(const CompressionCache* cache) {
+    DIR* directory = opendir(cache->directory);
+    if (directory == NULL) {
+        return;
+    }
+
+    CacheFile* files = NULL;
+    size_t file_count = 0;
+    size_t file_capacity = 0;
+    size_t total_size = 0;
+
+    struct dirent* entry;
+    while ((entry = readdir(directory)) != NULL) {
+        size_t name_length = strlen(entry->d_name);
+        size_t extension_length = strlen(CACHE_FILE_EXTENSION);
+        if (name_length <= extension_length || strcmp(entry->d_name + name_length - extension_length, CACHE_FILE_EXTENSION) != 0) {
+            // Temporary files of other processes are skipped as well.
+            continue;
+        }
+
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", cache->directory, entry->d_name);
+
+        struct stat file_stat;
+        if (stat(path, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+            continue;
+        }
+
+        if (file_count == file_capacity) {
+            file_capacity = file_capacity ? (file_capacity * 2) : 256;
+
+            CacheFile* new_files = realloc(files, file_capacity * sizeof(CacheFile));
+            if (new_files == NULL) {
+                break;
+            }
+
+            files = new_files;
+        }
+
+        files[file_count].path = strdup(path);
+        if (files[file_count].path == NULL) {
+            break;
+        }
+
+        files[file_count].size = file_stat.st_size;
+        files[file_count].access_time = file_stat.st_mtime;
+        file_count++;
+
+        total_size += file_stat.st_size;
+    }
+
+    closedir(directory);
+
+    if (total_size > cache->size_limit) {
+        qsort(files, file_count, sizeof(CacheFile), compare_cache_files);
+
+        for (size_t i = 0; i < file_count && total_size > cache->size_limit; i++) {
+            // Another process might have deleted the file already, it's gone either way.
+            unlink(files[i].path);
+            total_size -= files[i].size;
+        }
+    }
+
+    for (size_t i = 0; i < file_count; i++) {
+        free(files[i].path);
+    }
+    free(files);
+}
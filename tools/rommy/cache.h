@@ -0,0 +1,33 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "types.h"
+#include "structs.h"
+
+#define CACHE_DEFAULT_SIZE_LIMIT 0x10000000 // 256 MB
+
+// Compressed files stored on disk, named after a hash of the uncompressed data and the compression type.
+// Several processes can share the same directory, files are only ever replaced as a whole.
+typedef struct {
+    const char* directory;
+    size_t size_limit;
+    size_t hit_count;
+    size_t miss_count;
+} CompressionCache;
+
+// Creates the cache directory if it doesn't exist yet.
+bool cache_initialize(const CompressionCache* cache);
+
+// The hash is the hash_buffer of the uncompressed data, the caller already has it for the manifest.
+// Returns true and reads the compressed file into the buffer if it's in the cache.
+// The cached data is decompressed into the scratch buffer, which has to be as big as the uncompressed data, and compared to it.
+// That way a hash collision is just a miss.
+bool cache_load(const CompressionCache* cache, const u8* uncompressed_buffer, size_t uncompressed_size, u64 uncompressed_hash, CompressionType compression_type, u8* compressed_buffer, size_t compressed_capacity, size_t* compressed_size, u8* scratch_buffer);
+
+// Failing to store a file is not an error, it just won't be in the cache next time.
+void cache_store(const CompressionCache* cache, size_t uncompressed_size, u64 uncompressed_hash, CompressionType compression_type, const u8* compressed_buffer, size_t compressed_size);
+
+// Deletes the least recently used files until the cache fits into its size limit.
+void cache_trim(const CompressionCache* cache);
+
+#endif // CACHE_H
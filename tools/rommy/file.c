@@ -0,0 +1,122 @@
+#include "file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define FILE_WRITE_BLOCK_SIZE 0x10000
+
+const u8* file_map(const char* path, size_t* size) {
+    int file_descriptor = open(path, O_RDONLY);
+    if (file_descriptor < 0) {
+        return NULL;
+    }
+
+    struct stat file_stat;
+    if (fstat(file_descriptor, &file_stat) != 0 || file_stat.st_size <= 0) {
+        close(file_descriptor);
+        return NULL;
+    }
+
+    void* buffer = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+
+    // The mapping stays valid after closing the file.
+    close(file_descriptor);
+
+    if (buffer == MAP_FAILED) {
+        return NULL;
+    }
+
+    *size = file_stat.st_size;
+
+    return buffer;
+}
+
+void file_unmap(const u8* buffer, size_t size) {
+    if (buffer != NULL) {
+        munmap((void*)buffer, size);
+    }
+}
+
+static bool write_all(int file_descriptor, const u8* buffer, size_t size, off_t offset) {
+    while (size > 0) {
+        ssize_t written_size = pwrite(file_descriptor, buffer, size, offset);
+        if (written_size <= 0) {
+            return false;
+        }
+
+        buffer += written_size;
+        size -= written_size;
+        offset += written_size;
+    }
+
+    return true;
+}
+
+bool file_write_changed(const char* path, const u8* buffer, size_t size) {
+    int file_descriptor = open(path, O_RDWR | O_CREAT, 0644);
+    if (file_descriptor < 0) {
+        return false;
+    }
+
+    struct stat file_stat;
+    if (fstat(file_descriptor, &file_stat) != 0) {
+        close(file_descriptor);
+        return false;
+    }
+
+    size_t existing_size = file_stat.st_size;
+    const u8* existing_buffer = NULL;
+
+    if (existing_size > 0) {
+        void* mapping = mmap(NULL, existing_size, PROT_READ, MAP_SHARED, file_descriptor, 0);
+        if (mapping != MAP_FAILED) {
+            existing_buffer = mapping;
+        }
+    }
+
+    // Each block is compared before it is written, so the existing data that's still needed is never overwritten yet.
+    bool success = true;
+    for (size_t offset = 0; offset < size && success; offset += FILE_WRITE_BLOCK_SIZE) {
+        size_t block_size = (size - offset) < FILE_WRITE_BLOCK_SIZE ? (size - offset) : FILE_WRITE_BLOCK_SIZE;
+
+        bool is_unchanged = existing_buffer != NULL && (offset + block_size) <= existing_size && memcmp(existing_buffer + offset, buffer + offset, block_size) == 0;
+        if (!is_unchanged) {
+            success = write_all(file_descriptor, buffer + offset, block_size, offset);
+        }
+    }
+
+    if (existing_buffer != NULL) {
+        munmap((void*)existing_buffer, existing_size);
+    }
+
+    if (success && existing_size != size) {
+        success = ftruncate(file_descriptor, size) == 0;
+    }
+
+    // Unchanged blocks aren't written, so the modification time has to be updated by hand, make compares it with the inputs.
+    if (success) {
+        success = futimens(file_descriptor, NULL) == 0;
+    }
+
+    return (close(file_descriptor) == 0) && success;
+}
+
+bool file_create_directory(const char* path) {
+    char directory[4096];
+    snprintf(directory, sizeof(directory), "%s", path);
+
+    for (char* separator = strchr(directory + 1, '/'); separator != NULL; separator = strchr(separator + 1, '/')) {
+        *separator = '\0';
+        if (mkdir(directory, 0755) != 0 && errno != EEXIST) {
+            return false;
+        }
+        *separator = '/';
+    }
+
+    return mkdir(directory, 0755) == 0 || errno == EEXIST;
+}
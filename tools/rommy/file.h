@@ -0,0 +1,19 @@
+#ifndef FILE_H
+#define FILE_H
+
+#include "types.h"
+
+// Maps the whole file into memory read-only, returns NULL if it can't be opened, is empty or can't be mapped.
+const u8* file_map(const char* path, size_t* size);
+void file_unmap(const u8* buffer, size_t size);
+
+// Writes the buffer to the file, but only the blocks that differ from what the file already contains.
+// The file is created if it doesn't exist and truncated or extended to the size of the buffer.
+// Also works if the file is currently mapped with file_map, e.g. when the input and output file are the same.
+// The modification time is always updated, even if nothing changed, just like after writing the whole file.
+bool file_write_changed(const char* path, const u8* buffer, size_t size);
+
+// Creates the directory and every missing parent directory, it's not an error if it already exists.
+bool file_create_directory(const char* path);
+
+#endif // FILE_H
@@ -0,0 +1,12 @@
+#include "hash.h"
+
+u64 hash_buffer(const u8* buffer, size_t size) {
+    u64 hash = 0xCBF29CE484222325;
+
+    for (size_t i = 0; i < size; i++) {
+        hash ^= buffer[i];
+        hash *= 0x100000001B3;
+    }
+
+    return hash;
+}
@@ -0,0 +1,9 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include "types.h"
+
+// 64-bit FNV-1a, used to recognize files whose contents haven't changed.
+u64 hash_buffer(const u8* buffer, size_t size);
+
+#endif // HASH_H
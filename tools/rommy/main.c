@@ -1,12 +1,13 @@
 #include "main.h"
 #include "rommy.h"
+#include "file.h"
+#include "../n64crc/n64crc.h"
 
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-/* TODO: Instead of using a ROM as a reference, use some kind of a file that gets output when decompressing the ROM. */
-
 bool parse_arguments(int argc, const char* argv[], Arguments* arguments) {
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-i") == 0) {
@@ -27,6 +28,24 @@ bool parse_arguments(int argc, const char* argv[], Arguments* arguments) {
             }
 
             arguments->reference_file = argv[++i];
+        } else if (strcmp(argv[i], "-m") == 0) {
+            if (arguments->manifest_file || (i + 1) >= argc) {
+                return false;
+            }
+
+            arguments->manifest_file = argv[++i];
+        } else if (strcmp(argv[i], "-s") == 0) {
+            if (arguments->pack_manifest_file || (i + 1) >= argc) {
+                return false;
+            }
+
+            arguments->pack_manifest_file = argv[++i];
+        } else if (strcmp(argv[i], "-u") == 0) {
+            if (arguments->previous_file || (i + 1) >= argc) {
+                return false;
+            }
+
+            arguments->previous_file = argv[++i];
         } else if (strcmp(argv[i], "-c") == 0) {
             if (arguments->mode != MODE_UNDEFINED) {
                 return false;
@@ -39,6 +58,19 @@ bool parse_arguments(int argc, const char* argv[], Arguments* arguments) {
             }
 
             arguments->mode = MODE_DECOMPRESS;
+        } else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--verify") == 0) {
+            if (arguments->mode != MODE_UNDEFINED) {
+                return false;
+            }
+
+            arguments->mode = MODE_VERIFY;
+        } else if (strcmp(argv[i], "-x") == 0) {
+            if (arguments->mode != MODE_UNDEFINED || (i + 1) >= argc) {
+                return false;
+            }
+
+            arguments->mode = MODE_EXTRACT;
+            arguments->extract_list = argv[++i];
         } else if (strcmp(argv[i], "-a") == 0) {
             if (arguments->file_address_table_rom_address) {
                 return false;
@@ -51,12 +83,63 @@ bool parse_arguments(int argc, const char* argv[], Arguments* arguments) {
             }
 
             arguments->pad_output = true;
+        } else if (strcmp(argv[i], "-f") == 0) {
+            if (arguments->fix_crc) {
+                return false;
+            }
+
+            arguments->fix_crc = true;
+        } else if (strcmp(argv[i], "-t") == 0) {
+            if ((i + 1) >= argc) {
+                return false;
+            }
+
+            i++;
+
+            if (strcmp(argv[i], "accurate") == 0) {
+                arguments->compression_type = COMPRESSION_TYPE_ACCURATE;
+            } else if (strcmp(argv[i], "efficient") == 0) {
+                arguments->compression_type = COMPRESSION_TYPE_EFFICIENT;
+            } else if (strcmp(argv[i], "optimal") == 0) {
+                arguments->compression_type = COMPRESSION_TYPE_OPTIMAL;
+            } else {
+                return false;
+            }
+        } else if (strcmp(argv[i], "-j") == 0) {
+            if ((i + 1) >= argc) {
+                return false;
+            }
+
+            arguments->thread_count = strtol(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-k") == 0) {
+            if (arguments->cache_directory || (i + 1) >= argc) {
+                return false;
+            }
+
+            arguments->cache_directory = argv[++i];
+        } else if (strcmp(argv[i], "-l") == 0) {
+            if ((i + 1) >= argc) {
+                return false;
+            }
+
+            // Given in megabytes.
+            arguments->cache_size_limit = strtoull(argv[++i], NULL, 0) * 0x100000;
         }
     }
 
     // Check if the required arguments are set.
-    if (arguments->mode == MODE_UNDEFINED || !arguments->input_file || !arguments->output_file || !arguments->file_address_table_rom_address) {
-        printf("Error: You must specify a mode (compression/decompression), an input file, an output file and the offset of the file address table in ROM.\n");
+    if (arguments->mode == MODE_UNDEFINED || !arguments->input_file || (!arguments->output_file && arguments->mode != MODE_VERIFY) || !arguments->file_address_table_rom_address) {
+        printf("Error: You must specify a mode (compression/decompression/verification/extraction), an input file, an output file and the offset of the file address table in ROM.\n");
+        return false;
+    }
+
+    if (arguments->reference_file && arguments->manifest_file) {
+        printf("Error: You can either use a reference ROM file or a manifest file, not both.\n");
+        return false;
+    }
+
+    if (arguments->previous_file && (!arguments->pack_manifest_file || arguments->mode != MODE_COMPRESS)) {
+        printf("Error: A previous ROM file can only be used when compressing with a pack manifest file.\n");
         return false;
     }
 
@@ -90,16 +173,266 @@ bool parse_arguments(int argc, const char* argv[], Arguments* arguments) {
 }
 
 void print_help(void) {
-    printf("Usage: rommy -i <Path to the input ROM file> -o <Path to the output ROM file> (EITHER -c OR -d) -a <Offset of the file address table in ROM> [-r <Path to reference ROM file>] [-p]\n");
+    printf("Usage: rommy -i <Path to the input ROM file> -o <Path to the output ROM file> (EITHER -c OR -d OR -v OR -x <Files>) -a <Offset of the file address table in ROM> [-r <Path to reference ROM file>] [-m <Path to manifest file>] [-s <Path to pack manifest file> [-u <Path to previous output ROM file>]] [-p] [-f] [-t <Compression type>] [-j <Threads>] [-k <Path to cache directory>] [-l <Cache size limit in MB>]\n");
     printf("Compress or decompress a Nisitenma-Ichigo title using rommy.\n");
     printf("\n");
     printf("  -i  Specifies the path to the input ROM file.\n");
     printf("  -o  Specifies the path to the output ROM file.\n");
     printf("  -r  Specifies the path to the reference ROM file. Used to skip file compression on specific files so that the output ROM matches.\n");
+    printf("  -m  Specifies the path to the manifest file. Written when decompressing, used instead of a reference ROM file when compressing.\n");
+    printf("  -s  Specifies the path to the pack manifest file, written when compressing. Describes the files in the output ROM.\n");
+    printf("  -u  Specifies the path to the output ROM file of the last compression. Files that haven't changed according to the pack manifest are taken from it instead of being compressed.\n");
     printf("  -c  Compress the input file and save it to the output file.\n");
     printf("  -d  Decompress the input file and save it to the output file.\n");
+    printf("  -v  Verify every file of the compressed input file, no output file is needed. Compressed files are decompressed and compressed again,\n");
+    printf("      files are also compared against the manifest file or the reference ROM file if one is given. Also --verify.\n");
+    printf("  -x  Extract only the given files, e.g. 3,10-20 (indices in the file address table, the first file is 0). @<Path> reads the list from a file, one process can extract\n");
+    printf("      any number of files. Each file is written to <Output>/<Index>.bin, or all of them to stdout if the output file is -.\n");
     printf("  -a  Specifies the file address table offset in ROM.\n");
     printf("  -p  Pad the output file to the nearest power of two.\n");
+    printf("  -f  Fix the CRC in the header of the output file, same as running n64crc on it afterwards.\n");
+    printf("  -t  Specifies the compression type: accurate (default, matches the games), efficient or optimal (smallest output).\n");
+    printf("  -j  Number of threads used to compress or decompress files (default: 1). The output is the same for any number of threads.\n");
+    printf("  -k  Specifies a directory where compressed files are cached, unchanged files are taken from it instead of being compressed again.\n");
+    printf("  -l  Specifies the size limit of the cache directory in megabytes (default: 256). The least recently used files are deleted first.\n");
+}
+
+static const char* verify_status_name(VerifyStatus status) {
+    switch (status) {
+        case VERIFY_STATUS_MATCH:
+            return "match";
+        case VERIFY_STATUS_INVALID_ADDRESS:
+            return "invalid address";
+        case VERIFY_STATUS_DECOMPRESSION_FAILED:
+            return "decompression failed";
+        case VERIFY_STATUS_RECOMPRESSION_MISMATCH:
+            return "recompression mismatch";
+        case VERIFY_STATUS_MANIFEST_MISMATCH:
+            return "manifest mismatch";
+        case VERIFY_STATUS_REFERENCE_MISMATCH:
+            return "reference mismatch";
+    }
+
+    return "unknown";
+}
+
+// Prints one line for every file, so a ROM that doesn't match shows which files broke.
+static int verify(const Arguments* arguments, const u8* input_buffer, size_t input_size, const FileAddressTable* input_file_address_table, const u8* reference_buffer, size_t reference_size) {
+    Manifest manifest;
+    manifest.entries = NULL;
+
+    if (arguments->manifest_file) {
+        if (!manifest_read(arguments->manifest_file, &manifest)) {
+            printf("Error: Could not read manifest file.\n");
+            return EXIT_FAILURE;
+        }
+
+        if (manifest.file_address_table_rom_address != arguments->file_address_table_rom_address || manifest.size != input_file_address_table->size) {
+            printf("Error: Manifest file doesn't match the file address table of the input ROM.\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    // The files are compared against the files in the reference ROM, which are at their own addresses.
+    FileAddressTable reference_file_address_table;
+    reference_file_address_table.rom_addresses = NULL;
+    reference_file_address_table.is_compressed_in_reference = NULL;
+
+    if (reference_buffer != NULL) {
+        if (arguments->file_address_table_rom_address >= reference_size || !rommy_read_file_address_table(reference_buffer, NULL, &reference_file_address_table, reference_size, 0, arguments->file_address_table_rom_address) || reference_file_address_table.size != input_file_address_table->size) {
+            printf("Error: Reference file doesn't match the file address table of the input ROM.\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    size_t file_count = input_file_address_table->size - 1;
+    VerifiedFile* verified_files = calloc(file_count > 0 ? file_count : 1, sizeof(VerifiedFile));
+    if (verified_files == NULL || !rommy_verify(input_buffer, input_file_address_table, input_size, manifest.entries != NULL ? &manifest : NULL, reference_buffer, &reference_file_address_table, reference_size, arguments->compression_type, verified_files, arguments->thread_count)) {
+        printf("Error: Could not verify input file.\n");
+        return EXIT_FAILURE;
+    }
+
+    size_t compressed_file_count = 0;
+    size_t mismatch_count = 0;
+    double total_time = 0.0;
+
+    printf("Index  Compressed  Size in ROM  Uncompressed size  Time (ms)  Status\n");
+
+    for (size_t index = 0; index < file_count; index++) {
+        const VerifiedFile* verified_file = &verified_files[index];
+
+        printf("%5zu  %10s  %11zu  %17zu  %9.3f  %s\n", index, verified_file->is_compressed ? "yes" : "no", verified_file->compressed_size, verified_file->uncompressed_size, verified_file->time * 1000.0, verify_status_name(verified_file->status));
+
+        compressed_file_count += verified_file->is_compressed;
+        mismatch_count += verified_file->status != VERIFY_STATUS_MATCH;
+        total_time += verified_file->time;
+    }
+
+    printf("Verified %zu files (%zu compressed) in %.3f ms of work, %zu did not match.\n", file_count, compressed_file_count, total_time * 1000.0, mismatch_count);
+
+    free(verified_files);
+    rommy_free_file_address_table(&reference_file_address_table);
+    manifest_free(&manifest);
+
+    return mismatch_count == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Every file has to lie inside of the ROM, otherwise the ROM would be packed without it. Names the first file that doesn't.
+static bool check_files(const u8* input_buffer, size_t input_size, const FileAddressTable* input_file_address_table) {
+    size_t file_count = rommy_get_entry_count(input_file_address_table);
+
+    for (size_t index = 0; index < file_count; index++) {
+        RommyEntry entry;
+        if (!rommy_get_entry(input_buffer, input_file_address_table, input_size, index, &entry)) {
+            printf("Error: File %zu of the input ROM is invalid, its addresses don't lie inside of the ROM.\n", index);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Selects the files in a list like "3,10-20", lists read from a file can also be separated by whitespace.
+static bool parse_file_list(const char* list, bool* is_selected, size_t file_count) {
+    const char* position = list;
+
+    while (*position != '\0') {
+        if (*position == ',' || isspace((unsigned char)*position)) {
+            position++;
+            continue;
+        }
+
+        char* end = NULL;
+        size_t first_index = strtoull(position, &end, 0);
+        if (end == position) {
+            return false;
+        }
+
+        size_t last_index = first_index;
+        if (*end == '-') {
+            position = end + 1;
+            last_index = strtoull(position, &end, 0);
+            if (end == position) {
+                return false;
+            }
+        }
+
+        if (first_index > last_index || last_index >= file_count) {
+            return false;
+        }
+
+        for (size_t index = first_index; index <= last_index; index++) {
+            is_selected[index] = true;
+        }
+
+        position = end;
+    }
+
+    return true;
+}
+
+// Only the selected files are decompressed, the rest of the ROM is never touched. Files are numbered like in the file address table.
+// Errors go to stderr because the files themselves can be written to stdout.
+static int extract(const Arguments* arguments, const u8* input_buffer, size_t input_size, const FileAddressTable* input_file_address_table) {
+    size_t file_count = rommy_get_entry_count(input_file_address_table);
+
+    char* list = NULL;
+    if (arguments->extract_list[0] == '@') {
+        size_t list_size = 0;
+        const u8* list_buffer = file_map(arguments->extract_list + 1, &list_size);
+        if (list_buffer == NULL) {
+            fprintf(stderr, "Error: Could not open file list.\n");
+            return EXIT_FAILURE;
+        }
+
+        list = calloc(list_size + 1, 1);
+        if (list != NULL) {
+            memcpy(list, list_buffer, list_size);
+        }
+
+        file_unmap(list_buffer, list_size);
+    } else {
+        list = strdup(arguments->extract_list);
+    }
+
+    bool* is_selected = calloc(file_count > 0 ? file_count : 1, sizeof(bool));
+    if (list == NULL || is_selected == NULL) {
+        fprintf(stderr, "Error: Could not allocate memory for file list.\n");
+        return EXIT_FAILURE;
+    }
+
+    if (!parse_file_list(list, is_selected, file_count)) {
+        fprintf(stderr, "Error: Invalid file list, there are %zu files.\n", file_count);
+        return EXIT_FAILURE;
+    }
+
+    bool is_stdout = strcmp(arguments->output_file, "-") == 0;
+    if (!is_stdout && !file_create_directory(arguments->output_file)) {
+        fprintf(stderr, "Error: Could not create output directory.\n");
+        return EXIT_FAILURE;
+    }
+
+    // Grown as needed, every file is decompressed into the same buffer.
+    u8* file_buffer = NULL;
+    size_t file_capacity = 0;
+    size_t extracted_file_count = 0;
+
+    for (size_t index = 0; index < file_count; index++) {
+        if (!is_selected[index]) {
+            continue;
+        }
+
+        RommyEntry entry;
+        size_t uncompressed_file_size = 0;
+        if (!rommy_get_entry(input_buffer, input_file_address_table, input_size, index, &entry) || !rommy_get_entry_uncompressed_size(&entry, &uncompressed_file_size)) {
+            fprintf(stderr, "Error: File %zu is invalid.\n", index);
+            return EXIT_FAILURE;
+        }
+
+        if (uncompressed_file_size > file_capacity) {
+            u8* new_file_buffer = realloc(file_buffer, uncompressed_file_size);
+            if (new_file_buffer == NULL) {
+                fprintf(stderr, "Error: Could not allocate memory for file %zu.\n", index);
+                return EXIT_FAILURE;
+            }
+
+            file_buffer = new_file_buffer;
+            file_capacity = uncompressed_file_size;
+        }
+
+        size_t file_size = 0;
+        if (!rommy_decode_entry(&entry, file_buffer, file_capacity, &file_size)) {
+            fprintf(stderr, "Error: Could not decompress file %zu.\n", index);
+            return EXIT_FAILURE;
+        }
+
+        if (is_stdout) {
+            if (fwrite(file_buffer, 1, file_size, stdout) != file_size) {
+                fprintf(stderr, "Error: Could not write file %zu.\n", index);
+                return EXIT_FAILURE;
+            }
+        } else {
+            char path[4096];
+            snprintf(path, sizeof(path), "%s/%zu.bin", arguments->output_file, index);
+
+            if (!file_write_changed(path, file_buffer, file_size)) {
+                fprintf(stderr, "Error: Could not write file %zu.\n", index);
+                return EXIT_FAILURE;
+            }
+        }
+
+        extracted_file_count++;
+    }
+
+    if (!is_stdout) {
+        printf("Extracted %zu files.\n", extracted_file_count);
+    }
+
+    free(file_buffer);
+    free(is_selected);
+    free(list);
+
+    return EXIT_SUCCESS;
 }
 
 int main(int argc, const char* argv[]) {
@@ -108,74 +441,128 @@ int main(int argc, const char* argv[]) {
     arguments.input_file = NULL;
     arguments.output_file = NULL;
     arguments.reference_file = NULL;
+    arguments.manifest_file = NULL;
+    arguments.pack_manifest_file = NULL;
+    arguments.previous_file = NULL;
+    arguments.extract_list = NULL;
     arguments.file_address_table_rom_address = 0;
     arguments.pad_output = false;
+    arguments.fix_crc = false;
+    arguments.compression_type = COMPRESSION_TYPE_ACCURATE;
+    arguments.thread_count = 1;
+    arguments.cache_directory = NULL;
+    arguments.cache_size_limit = CACHE_DEFAULT_SIZE_LIMIT;
 
     if (!parse_arguments(argc, argv, &arguments)) {
         print_help();
         return EXIT_FAILURE;
     }
 
-    FILE* input_file = fopen(arguments.input_file, "rb");
-    if (input_file == NULL) {
+    // The ROMs are only read, so they are mapped instead of read into memory, only the pages that are used get loaded.
+    size_t input_size = 0;
+    const u8* input_buffer = file_map(arguments.input_file, &input_size);
+    if (input_buffer == NULL) {
         printf("Error: Could not open input file.\n");
         return EXIT_FAILURE;
     }
 
-    fseek(input_file, 0, SEEK_END);
-    size_t input_size = ftell(input_file);
-    fseek(input_file, 0, SEEK_SET);
+    const u8* reference_buffer = NULL;
+    size_t reference_size = 0;
 
-    u8* input_buffer = malloc(input_size);
-    if (input_buffer == NULL) {
-        printf("Error: Could not allocate memory for input buffer.\n");
-        return EXIT_FAILURE;
+    if (arguments.reference_file) {
+        reference_buffer = file_map(arguments.reference_file, &reference_size);
+        if (reference_buffer == NULL) {
+            printf("Error: Could not open reference file.\n");
+            return EXIT_FAILURE;
+        }
     }
 
-    if (fread(input_buffer, 1, input_size, input_file) != input_size) {
-        printf("Error: Could not read input file.\n");
+    if (arguments.file_address_table_rom_address >= input_size) {
+        printf("Error: File address table offset exceeds input ROM size.\n");
         return EXIT_FAILURE;
     }
 
-    fclose(input_file);
+    FileAddressTable input_file_address_table;
+    if (!rommy_read_file_address_table(input_buffer, reference_buffer, &input_file_address_table, input_size, reference_size, arguments.file_address_table_rom_address)) {
+        printf("Error: Could not read file address table.\n");
+        return EXIT_FAILURE;
+    }
 
-    FILE* reference_file = NULL;
-    u8* reference_buffer = NULL;
-    size_t reference_size = 0;
+    Manifest manifest;
+    manifest.entries = NULL;
 
-    if (arguments.reference_file) {
-        reference_file = fopen(arguments.reference_file, "rb");
-        if (reference_file == NULL) {
-            printf("Error: Could not open reference file.\n");
+    if (arguments.manifest_file && arguments.mode == MODE_COMPRESS) {
+        if (!manifest_read(arguments.manifest_file, &manifest)) {
+            printf("Error: Could not read manifest file.\n");
             return EXIT_FAILURE;
         }
 
-        fseek(reference_file, 0, SEEK_END);
-        reference_size = ftell(reference_file);
-        fseek(reference_file, 0, SEEK_SET);
-
-        reference_buffer = malloc(reference_size);
-        if (reference_buffer == NULL) {
-            printf("Error: Could not allocate memory for reference buffer.\n");
+        if (manifest.file_address_table_rom_address != arguments.file_address_table_rom_address || !rommy_apply_manifest(&input_file_address_table, &manifest)) {
+            printf("Error: Manifest file doesn't match the file address table of the input ROM.\n");
             return EXIT_FAILURE;
         }
-
-        if (fread(reference_buffer, 1, reference_size, reference_file) != reference_size) {
-            printf("Error: Could not read reference file.\n");
+    } else if (arguments.manifest_file && arguments.mode == MODE_DECOMPRESS) {
+        if (!manifest_create(&manifest, arguments.file_address_table_rom_address, input_file_address_table.size)) {
+            printf("Error: Could not allocate memory for manifest.\n");
             return EXIT_FAILURE;
         }
+    }
+
+    if (arguments.mode == MODE_VERIFY) {
+        int result = verify(&arguments, input_buffer, input_size, &input_file_address_table, reference_buffer, reference_size);
+
+        file_unmap(input_buffer, input_size);
+        file_unmap(reference_buffer, reference_size);
+        rommy_free_file_address_table(&input_file_address_table);
 
-        fclose(reference_file);
+        return result;
     }
 
-    if (arguments.file_address_table_rom_address >= input_size) {
-        printf("Error: File address table offset exceeds input ROM size.\n");
-        return EXIT_FAILURE;
+    if (arguments.mode == MODE_EXTRACT) {
+        int result = extract(&arguments, input_buffer, input_size, &input_file_address_table);
+
+        file_unmap(input_buffer, input_size);
+        file_unmap(reference_buffer, reference_size);
+        rommy_free_file_address_table(&input_file_address_table);
+
+        return result;
     }
 
-    FileAddressTable input_file_address_table;
-    if (!rommy_read_file_address_table(input_buffer, reference_buffer, &input_file_address_table, input_size, reference_size, arguments.file_address_table_rom_address)) {
-        printf("Error: Could not read file address table.\n");
+    // Everything can still be compressed from scratch if the previous ROM is missing or doesn't match its pack manifest.
+    Manifest previous_manifest;
+    previous_manifest.entries = NULL;
+    FileAddressTable previous_file_address_table;
+    previous_file_address_table.rom_addresses = NULL;
+    previous_file_address_table.is_compressed_in_reference = NULL;
+    size_t previous_size = 0;
+    const u8* previous_buffer = NULL;
+    PreviousPack previous_pack;
+    bool use_previous_pack = false;
+
+    if (arguments.previous_file) {
+        previous_buffer = file_map(arguments.previous_file, &previous_size);
+
+        use_previous_pack = previous_buffer != NULL && manifest_read(arguments.pack_manifest_file, &previous_manifest);
+        use_previous_pack = use_previous_pack && previous_manifest.file_address_table_rom_address == arguments.file_address_table_rom_address && previous_manifest.size == input_file_address_table.size;
+        use_previous_pack = use_previous_pack && arguments.file_address_table_rom_address < previous_size && rommy_read_file_address_table(previous_buffer, NULL, &previous_file_address_table, previous_size, 0, arguments.file_address_table_rom_address);
+        use_previous_pack = use_previous_pack && previous_file_address_table.size == input_file_address_table.size;
+
+        if (use_previous_pack) {
+            previous_pack.rom_buffer = previous_buffer;
+            previous_pack.rom_buffer_size = previous_size;
+            previous_pack.file_address_table = &previous_file_address_table;
+            previous_pack.manifest = &previous_manifest;
+            previous_pack.reused_file_count = 0;
+        } else {
+            printf("Previous ROM file or pack manifest file can't be used, compressing every file.\n");
+        }
+    }
+
+    Manifest pack_manifest;
+    pack_manifest.entries = NULL;
+
+    if (arguments.pack_manifest_file && arguments.mode == MODE_COMPRESS && !manifest_create(&pack_manifest, arguments.file_address_table_rom_address, input_file_address_table.size)) {
+        printf("Error: Could not allocate memory for pack manifest.\n");
         return EXIT_FAILURE;
     }
 
@@ -183,17 +570,61 @@ int main(int argc, const char* argv[]) {
     output_file_address_table.size = input_file_address_table.size;
     output_file_address_table.rom_addresses = calloc(output_file_address_table.size, sizeof(u32));
     output_file_address_table.is_compressed_in_reference = calloc(output_file_address_table.size, sizeof(bool));
+    if (output_file_address_table.rom_addresses == NULL || output_file_address_table.is_compressed_in_reference == NULL) {
+        printf("Error: Could not allocate memory for output file address table.\n");
+        return EXIT_FAILURE;
+    }
+
     memcpy(output_file_address_table.rom_addresses, input_file_address_table.rom_addresses, input_file_address_table.size * sizeof(u32));
     memcpy(output_file_address_table.is_compressed_in_reference, input_file_address_table.is_compressed_in_reference, input_file_address_table.size * sizeof(bool));
 
     size_t output_size = ROMMY_MAXIMUM_ROM_SIZE;
     u8 *output_buffer = malloc(output_size);
-    memcpy(output_buffer, input_buffer, input_size);
+    if (output_buffer == NULL) {
+        printf("Error: Could not allocate memory for output buffer.\n");
+        return EXIT_FAILURE;
+    }
+
+    // Only the data in front of the first file is kept as is, the files are all laid out again after it.
+    size_t first_file_rom_address = input_file_address_table.rom_addresses[0] & 0x7FFFFFFF;
+    memcpy(output_buffer, input_buffer, first_file_rom_address < input_size ? first_file_rom_address : input_size);
 
     if (arguments.mode == MODE_COMPRESS) {
-        output_size = rommy_compress(input_buffer, output_buffer, &input_file_address_table, &output_file_address_table, input_size, output_size);
+        if (!check_files(input_buffer, input_size, &input_file_address_table)) {
+            return EXIT_FAILURE;
+        }
+
+        CompressionCache cache;
+        cache.directory = arguments.cache_directory;
+        cache.size_limit = arguments.cache_size_limit;
+        cache.hit_count = 0;
+        cache.miss_count = 0;
+
+        bool use_cache = arguments.cache_directory != NULL;
+        if (use_cache && !cache_initialize(&cache)) {
+            printf("Warning: Could not create cache directory, compressing without cache.\n");
+            use_cache = false;
+        }
+
+        output_size = rommy_compress(input_buffer, output_buffer, &input_file_address_table, &output_file_address_table, input_size, output_size, arguments.compression_type, use_cache ? &cache : NULL, use_previous_pack ? &previous_pack : NULL, pack_manifest.entries != NULL ? &pack_manifest : NULL, arguments.thread_count);
+        if (output_size == 0) {
+            printf("Error: Could not compress input file.\n");
+            return EXIT_FAILURE;
+        }
+
+        if (use_cache) {
+            printf("Compression cache: %zu hits, %zu misses.\n", cache.hit_count, cache.miss_count);
+        }
+
+        if (use_previous_pack) {
+            printf("Previous ROM: %zu unchanged files reused.\n", previous_pack.reused_file_count);
+        }
     } else if (arguments.mode == MODE_DECOMPRESS) {
-        output_size = rommy_decompress(input_buffer, output_buffer, &input_file_address_table, &output_file_address_table, input_size, output_size);
+        output_size = rommy_decompress(input_buffer, output_buffer, &input_file_address_table, &output_file_address_table, input_size, output_size, manifest.entries != NULL ? &manifest : NULL, arguments.thread_count);
+        if (output_size == 0) {
+            printf("Error: Could not decompress input file.\n");
+            return EXIT_FAILURE;
+        }
     } else {
         printf("Error: Invalid mode.\n");
         return EXIT_FAILURE;
@@ -212,7 +643,7 @@ int main(int argc, const char* argv[]) {
         nearest_power_of_two_size += 1;
 
         // Zero out any remaining data since the input ROM file might have data left after the file data.
-        memset(output_buffer + output_size, 0, nearest_power_of_two_size);
+        memset(output_buffer + output_size, 0, nearest_power_of_two_size - output_size);
 
         output_size = nearest_power_of_two_size;
     }
@@ -222,24 +653,46 @@ int main(int argc, const char* argv[]) {
         return EXIT_FAILURE;
     }
 
-    FILE* output_file = fopen(arguments.output_file, "wb");
-    if (output_file == NULL) {
-        printf("Error: Could not open output file.\n");
+    // Done on the finished ROM in memory, so the CRC is always over the bytes that get written.
+    if (arguments.fix_crc && N64FixCRC(output_buffer, output_size) != 0) {
+        printf("Error: Could not calculate the CRC of the output file.\n");
         return EXIT_FAILURE;
     }
 
-    if (fwrite(output_buffer, 1, output_size, output_file) != output_size) {
+    // The old pack manifest doesn't describe the new output file anymore, it must never be used with it.
+    if (pack_manifest.entries != NULL) {
+        remove(arguments.pack_manifest_file);
+    }
+
+    // The output file is often the input file, so only the parts that actually changed are written.
+    if (!file_write_changed(arguments.output_file, output_buffer, output_size)) {
         printf("Error: Could not write output file.\n");
         return EXIT_FAILURE;
     }
 
-    fclose(output_file);
+    if (arguments.manifest_file && arguments.mode == MODE_DECOMPRESS && !manifest_write(arguments.manifest_file, &manifest)) {
+        printf("Error: Could not write manifest file.\n");
+        return EXIT_FAILURE;
+    }
+
+    if (pack_manifest.entries != NULL && !manifest_write(arguments.pack_manifest_file, &pack_manifest)) {
+        printf("Error: Could not write pack manifest file.\n");
+        return EXIT_FAILURE;
+    }
+
+    manifest_free(&manifest);
+    manifest_free(&pack_manifest);
+    manifest_free(&previous_manifest);
+
+    rommy_free_file_address_table(&previous_file_address_table);
+    file_unmap(previous_buffer, previous_size);
 
-    free(input_buffer);
-    free(input_file_address_table.rom_addresses);
+    file_unmap(input_buffer, input_size);
+    file_unmap(reference_buffer, reference_size);
+    rommy_free_file_address_table(&input_file_address_table);
     
     free(output_buffer);
-    free(output_file_address_table.rom_addresses);
+    rommy_free_file_address_table(&output_file_address_table);
 
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,116 @@
+#include "manifest.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MANIFEST_HEADER_SIZE 16
+#define MANIFEST_ENTRY_SIZE 20
+
+static void write_u32(u8* buffer, u32 value) {
+    buffer[0] = value >> 24;
+    buffer[1] = value >> 16;
+    buffer[2] = value >> 8;
+    buffer[3] = value;
+}
+
+static u32 read_u32(const u8* buffer) {
+    return ((u32)buffer[0] << 24) | ((u32)buffer[1] << 16) | ((u32)buffer[2] << 8) | buffer[3];
+}
+
+bool manifest_create(Manifest* manifest, u32 file_address_table_rom_address, size_t size) {
+    manifest->file_address_table_rom_address = file_address_table_rom_address;
+    manifest->size = size;
+    manifest->entries = calloc(size > 0 ? size : 1, sizeof(ManifestEntry));
+
+    return manifest->entries != NULL;
+}
+
+void manifest_free(Manifest* manifest) {
+    free(manifest->entries);
+    manifest->entries = NULL;
+    manifest->size = 0;
+}
+
+bool manifest_write(const char* path, const Manifest* manifest) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+
+    u8 header[MANIFEST_HEADER_SIZE];
+    write_u32(header + 0x0, MANIFEST_MAGIC);
+    write_u32(header + 0x4, MANIFEST_VERSION);
+    write_u32(header + 0x8, manifest->file_address_table_rom_address);
+    write_u32(header + 0xC, manifest->size);
+
+    bool success = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+
+    for (size_t i = 0; i < manifest->size && success; i++) {
+        const ManifestEntry* entry = &manifest->entries[i];
+
+        u8 buffer[MANIFEST_ENTRY_SIZE];
+        u32 flags = entry->is_compressed ? 1 : 0;
+        if (entry->has_compression_type) {
+            flags |= 2 | (entry->compression_type << 2);
+        }
+
+        write_u32(buffer + 0x0, flags);
+        write_u32(buffer + 0x4, entry->compressed_size);
+        write_u32(buffer + 0x8, entry->uncompressed_size);
+        write_u32(buffer + 0xC, entry->hash >> 32);
+        write_u32(buffer + 0x10, entry->hash);
+
+        success = fwrite(buffer, 1, sizeof(buffer), file) == sizeof(buffer);
+    }
+
+    return (fclose(file) == 0) && success;
+}
+
+bool manifest_read(const char* path, Manifest* manifest) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+
+    u8 header[MANIFEST_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) || read_u32(header + 0x0) != MANIFEST_MAGIC || (read_u32(header + 0x4) != MANIFEST_VERSION && read_u32(header + 0x4) != 1)) {
+        fclose(file);
+        return false;
+    }
+
+    // Version 1 was written for a table that started with an empty entry, which isn't a file of the game.
+    size_t skipped_entry_count = read_u32(header + 0x4) == 1 ? 1 : 0;
+    u8 skipped_buffer[MANIFEST_ENTRY_SIZE];
+    if (skipped_entry_count > read_u32(header + 0xC) || (skipped_entry_count > 0 && fread(skipped_buffer, 1, sizeof(skipped_buffer), file) != sizeof(skipped_buffer))) {
+        fclose(file);
+        return false;
+    }
+
+    if (!manifest_create(manifest, read_u32(header + 0x8), read_u32(header + 0xC) - skipped_entry_count)) {
+        fclose(file);
+        return false;
+    }
+
+    for (size_t i = 0; i < manifest->size; i++) {
+        ManifestEntry* entry = &manifest->entries[i];
+
+        u8 buffer[MANIFEST_ENTRY_SIZE];
+        if (fread(buffer, 1, sizeof(buffer), file) != sizeof(buffer)) {
+            manifest_free(manifest);
+            fclose(file);
+            return false;
+        }
+
+        u32 flags = read_u32(buffer + 0x0);
+        entry->is_compressed = flags & 1;
+        entry->has_compression_type = (flags >> 1) & 1;
+        entry->compression_type = (flags >> 2) & 3;
+        entry->compressed_size = read_u32(buffer + 0x4);
+        entry->uncompressed_size = read_u32(buffer + 0x8);
+        entry->hash = ((u64)read_u32(buffer + 0xC) << 32) | read_u32(buffer + 0x10);
+    }
+
+    fclose(file);
+
+    return true;
+}
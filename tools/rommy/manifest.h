@@ -0,0 +1,39 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include "types.h"
+#include "structs.h"
+
+#define MANIFEST_MAGIC 0x524D4D46 // "RMMF"
+#define MANIFEST_VERSION 2
+
+// Everything rommy needs to know about the files of a ROM. Decompressing writes one for the original ROM,
+// compressing with it gives the same ROM as compressing with the original ROM as reference.
+// Compressing can write one for the output ROM (a pack manifest), so the next compression can reuse unchanged files.
+typedef struct {
+    bool is_compressed; // Whether the file is compressed in the ROM.
+    bool has_compression_type; // Only known for files rommy compressed itself.
+    CompressionType compression_type;
+    u32 compressed_size; // Size of the file in the ROM, compressed or not.
+    u32 uncompressed_size;
+    u64 hash; // Hash of the uncompressed file.
+} ManifestEntry;
+
+typedef struct {
+    u32 file_address_table_rom_address;
+    size_t size; // Same as the size of the file address table, entry N is game file N.
+    ManifestEntry* entries;
+} Manifest;
+
+bool manifest_create(Manifest* manifest, u32 file_address_table_rom_address, size_t size);
+void manifest_free(Manifest* manifest);
+
+// All values are stored big endian:
+// u32 magic, u32 version, u32 file address table ROM address, u32 entry count,
+// then for every entry: u32 flags, u32 compressed size, u32 uncompressed size, u64 hash.
+// Flags: bit 0 is set if compressed, bit 1 is set if the compression type is known, bits 2-3 are the compression type.
+// Version 1 manifests have an extra empty entry in front, which is dropped when they are read.
+bool manifest_write(const char* path, const Manifest* manifest);
+bool manifest_read(const char* path, Manifest* manifest);
+
+#endif // MANIFEST_H
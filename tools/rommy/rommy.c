@@ -1,11 +1,58 @@
 #include "rommy.h"
 #include "types.h"
 #include "structs.h"
+#include "cache.h"
+#include "hash.h"
+#include "manifest.h"
 #include "../lzkn64/lzkn64.h"
 
 #include <byteswap.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+typedef struct {
+    u8* buffer; // A slot in the arena that is big enough for the file no matter how badly it compresses.
+    size_t capacity;
+    const u8* data; // Either the slot or the file in the previous ROM.
+    size_t size;
+    u64 hash; // Hash of the uncompressed file.
+    bool is_compressed;
+} CompressedFile;
+
+typedef struct {
+    const u8* input_rom_buffer;
+    const FileAddressTable* input_file_address_table;
+    size_t input_rom_buffer_size;
+    CompressionType compression_type;
+    CompressedFile* compressed_files;
+    CompressionCache* cache; // Can be NULL.
+    PreviousPack* previous_pack; // Can be NULL.
+    size_t maximum_uncompressed_file_size; // Size of the scratch buffer every thread needs to check cached files.
+    pthread_mutex_t* mutex; // Also protects the cache and previous pack counters.
+    size_t* next_index; // Shared between all tasks, every thread takes the next file that nobody has started yet.
+    bool success;
+} CompressFilesTask;
+
+typedef struct {
+    const u8* input_buffer;
+    size_t input_size;
+    size_t output_rom_address;
+    size_t output_size;
+    bool is_compressed; // Whether the file is compressed in the input ROM.
+    bool needs_decoding; // Empty files are compressed, but just copied.
+} DecompressedFile;
+
+typedef struct {
+    const DecompressedFile* files;
+    size_t file_count;
+    u8* output_rom_buffer;
+    Manifest* manifest; // Can be NULL.
+    pthread_mutex_t* mutex;
+    size_t* next_index; // Shared between all tasks, every thread takes the next file that nobody has started yet.
+    bool success;
+} DecompressFilesTask;
 
 bool rommy_read_file_address_table(const u8* input_rom_buffer, const u8* reference_rom_buffer, FileAddressTable* file_address_table, const size_t input_rom_buffer_size, const size_t reference_rom_buffer_size, const size_t file_address_table_rom_address) {
     FileAddressTableEntry* input_entry = (FileAddressTableEntry*)(input_rom_buffer + file_address_table_rom_address);
@@ -22,57 +69,401 @@ bool rommy_read_file_address_table(const u8* input_rom_buffer, const u8* referen
         input_entry = (FileAddressTableEntry*)(input_rom_buffer + file_address_table_rom_address + (index * sizeof(u32)));
     }
     
-    size_t file_address_table_size = index + 1;
+    if (index == 0) {
+        // Without even an end address there is no table.
+        return false;
+    }
 
-    file_address_table->size = file_address_table_size;
+    // Every start address, the last one is only the end address of the last file. The terminating zero isn't part of the table.
+    file_address_table->size = index;
     file_address_table->rom_addresses = calloc(file_address_table->size, sizeof(u32));
     file_address_table->is_compressed_in_reference = calloc(file_address_table->size, sizeof(bool));
-
-    input_entry = (FileAddressTableEntry*)(input_rom_buffer + file_address_table_rom_address);
-
-    FileAddressTableEntry* reference_entry = NULL;
-    if (reference_rom_buffer) {
-        reference_entry = (FileAddressTableEntry*)(reference_rom_buffer + file_address_table_rom_address);
+    if (file_address_table->rom_addresses == NULL || file_address_table->is_compressed_in_reference == NULL) {
+        rommy_free_file_address_table(file_address_table);
+        return false;
     }
 
     for (index = 0; index < file_address_table->size; index++) {
+        input_entry = (FileAddressTableEntry*)(input_rom_buffer + file_address_table_rom_address + (index * sizeof(u32)));
         file_address_table->rom_addresses[index] = bswap_32(input_entry->start_rom_address);
 
         if (reference_rom_buffer) {
+            FileAddressTableEntry* reference_entry = (FileAddressTableEntry*)(reference_rom_buffer + file_address_table_rom_address + (index * sizeof(u32)));
             if ((bswap_32(reference_entry->start_rom_address) & 0x7FFFFFFF) > reference_rom_buffer_size || (bswap_32(reference_entry->end_rom_address) & 0x7FFFFFFF) > reference_rom_buffer_size) {
                 // Most likely an invalid table, abort.
                 return false;
             }
 
             file_address_table->is_compressed_in_reference[index] = bswap_32(reference_entry->start_rom_address) >> 31;
-
-            reference_entry = (FileAddressTableEntry*)(reference_rom_buffer + file_address_table_rom_address + (index * sizeof(u32)));
         }
-
-        input_entry = (FileAddressTableEntry*)(input_rom_buffer + file_address_table_rom_address + (index * sizeof(u32)));
     }
 
     return true;
 }
 
-bool rommy_write_file_address_table(const u8* rom_buffer, const FileAddressTable* file_address_table, const size_t rom_buffer_size, const size_t file_address_table_rom_address) {
-    FileAddressTableEntry* entry = (FileAddressTableEntry*)(rom_buffer + file_address_table_rom_address);
+void rommy_free_file_address_table(FileAddressTable* file_address_table) {
+    free(file_address_table->rom_addresses);
+    free(file_address_table->is_compressed_in_reference);
 
+    file_address_table->rom_addresses = NULL;
+    file_address_table->is_compressed_in_reference = NULL;
+}
+
+bool rommy_write_file_address_table(const u8* rom_buffer, const FileAddressTable* file_address_table, const size_t rom_buffer_size, const size_t file_address_table_rom_address) {
     for (size_t index = 0; index < file_address_table->size; index++) {
         if ((file_address_table->rom_addresses[index] & 0x7FFFFFFF) > rom_buffer_size) {
             // Most likely an invalid table, abort.
             return false;
         }
 
+        FileAddressTableEntry* entry = (FileAddressTableEntry*)(rom_buffer + file_address_table_rom_address + (index * sizeof(u32)));
         entry->start_rom_address = bswap_32(file_address_table->rom_addresses[index]);
+    }
+
+    return true;
+}
+
+typedef struct {
+    const u8* rom_buffer;
+    const FileAddressTable* file_address_table;
+    size_t rom_buffer_size;
+    const Manifest* manifest; // Can be NULL.
+    const u8* reference_rom_buffer; // Can be NULL.
+    const FileAddressTable* reference_file_address_table;
+    size_t reference_rom_buffer_size;
+    CompressionType compression_type; // Used for files the manifest doesn't know the compression type of.
+    VerifiedFile* verified_files;
+    pthread_mutex_t* mutex;
+    size_t* next_index; // Shared between all tasks, every thread takes the next file that nobody has started yet.
+    bool success;
+} VerifyFilesTask;
+
+bool rommy_apply_manifest(FileAddressTable* file_address_table, const Manifest* manifest) {
+    if (manifest->size != file_address_table->size) {
+        // The manifest was written for a different ROM.
+        return false;
+    }
+
+    for (size_t index = 0; index < file_address_table->size; index++) {
+        file_address_table->is_compressed_in_reference[index] = manifest->entries[index].is_compressed;
+    }
+
+    return true;
+}
+
+size_t rommy_get_entry_count(const FileAddressTable* file_address_table) {
+    return file_address_table->size > 0 ? file_address_table->size - 1 : 0;
+}
+
+bool rommy_get_entry(const u8* rom_buffer, const FileAddressTable* file_address_table, const size_t rom_buffer_size, const size_t index, RommyEntry* entry) {
+    if (index >= rommy_get_entry_count(file_address_table)) {
+        return false;
+    }
+
+    const FileAddressTableEntry* table_entry = (const FileAddressTableEntry*)(file_address_table->rom_addresses + index);
+    u32 start_rom_address = table_entry->start_rom_address & 0x7FFFFFFF;
+    u32 end_rom_address = table_entry->end_rom_address & 0x7FFFFFFF;
+
+    if (end_rom_address < start_rom_address || end_rom_address > rom_buffer_size) {
+        return false;
+    }
+
+    entry->index = index;
+    entry->is_compressed = (table_entry->start_rom_address) >> 31;
+    entry->start_rom_address = start_rom_address;
+    entry->end_rom_address = end_rom_address;
+    entry->data = rom_buffer + start_rom_address;
+    entry->size = end_rom_address - start_rom_address;
 
-        entry = (FileAddressTableEntry*)(rom_buffer + file_address_table_rom_address + (index * sizeof(u32)));
+    return true;
+}
+
+void rommy_iterator_initialize(RommyIterator* iterator, const u8* rom_buffer, const FileAddressTable* file_address_table, const size_t rom_buffer_size) {
+    iterator->rom_buffer = rom_buffer;
+    iterator->rom_buffer_size = rom_buffer_size;
+    iterator->file_address_table = file_address_table;
+    iterator->next_index = 0;
+}
+
+bool rommy_iterator_next(RommyIterator* iterator, RommyEntry* entry) {
+    if (!rommy_get_entry(iterator->rom_buffer, iterator->file_address_table, iterator->rom_buffer_size, iterator->next_index, entry)) {
+        return false;
     }
 
+    iterator->next_index++;
+
     return true;
 }
 
-size_t rommy_compress(const u8* input_rom_buffer, u8* output_rom_buffer, const FileAddressTable* input_file_address_table, FileAddressTable* output_file_address_table, const size_t input_rom_buffer_size, const size_t output_rom_buffer_size) {
+bool rommy_get_entry_uncompressed_size(const RommyEntry* entry, size_t* uncompressed_size) {
+    // Empty files are marked as compressed, but they don't contain any data.
+    if (!entry->is_compressed || entry->size == 0) {
+        *uncompressed_size = entry->size;
+        return true;
+    }
+
+    return lzkn64_decompressed_size(entry->data, entry->size, uncompressed_size);
+}
+
+bool rommy_decode_entry(const RommyEntry* entry, u8* output_buffer, const size_t output_capacity, size_t* output_size) {
+    if (!entry->is_compressed || entry->size == 0) {
+        if (entry->size > output_capacity) {
+            return false;
+        }
+
+        memcpy(output_buffer, entry->data, entry->size);
+        *output_size = entry->size;
+
+        return true;
+    }
+
+    size_t compressed_file_consumed = 0;
+    return lzkn64_decompress_checked(entry->data, entry->size, output_buffer, output_capacity, &compressed_file_consumed, output_size);
+}
+
+// Returns true if the file gets compressed, otherwise it's copied as is.
+static bool should_compress_file(const FileAddressTable* input_file_address_table, const size_t index) {
+    const FileAddressTableEntry* input_entry = (const FileAddressTableEntry*)(input_file_address_table->rom_addresses + index);
+
+    bool is_compressed = (input_entry->start_rom_address) >> 31;
+    bool is_empty_file = !((input_entry->end_rom_address - input_entry->start_rom_address) & 0x7FFFFFFF);
+
+    return !(is_compressed || is_empty_file || !input_file_address_table->is_compressed_in_reference[index]);
+}
+
+// Runs the function on the given number of threads, all of them get the same task. The calling thread is one of them.
+// The function has to split the work between the threads by itself.
+static void run_on_threads(void* (*function)(void*), void* task, size_t thread_count) {
+    pthread_t* threads = calloc(thread_count, sizeof(pthread_t));
+    bool* is_thread_started = calloc(thread_count, sizeof(bool));
+
+    // If the threads can't be created, the calling thread does all of the work.
+    for (size_t i = 1; i < thread_count && threads != NULL && is_thread_started != NULL; i++) {
+        is_thread_started[i] = pthread_create(&threads[i], NULL, function, task) == 0;
+    }
+
+    function(task);
+
+    for (size_t i = 1; i < thread_count && threads != NULL && is_thread_started != NULL; i++) {
+        if (is_thread_started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+
+    free(threads);
+    free(is_thread_started);
+}
+
+// Returns the file from the previous ROM if it was compressed the same way from the same data.
+static bool find_previous_file(const PreviousPack* previous_pack, const size_t index, size_t uncompressed_file_size, u64 hash, CompressionType compression_type, const u8** compressed_file_buffer, size_t* compressed_file_size) {
+    const ManifestEntry* manifest_entry = &previous_pack->manifest->entries[index];
+    if (!manifest_entry->is_compressed || !manifest_entry->has_compression_type || manifest_entry->compression_type != compression_type || manifest_entry->uncompressed_size != uncompressed_file_size || manifest_entry->hash != hash) {
+        return false;
+    }
+
+    const FileAddressTableEntry* previous_entry = (const FileAddressTableEntry*)(previous_pack->file_address_table->rom_addresses + index);
+    u32 start_rom_address = previous_entry->start_rom_address & 0x7FFFFFFF;
+    u32 end_rom_address = previous_entry->end_rom_address & 0x7FFFFFFF;
+
+    // Make sure the previous ROM still is the one the manifest was written for.
+    if (!(previous_entry->start_rom_address >> 31) || end_rom_address < start_rom_address || end_rom_address > previous_pack->rom_buffer_size || (end_rom_address - start_rom_address) != manifest_entry->compressed_size) {
+        return false;
+    }
+
+    *compressed_file_buffer = previous_pack->rom_buffer + start_rom_address;
+    *compressed_file_size = end_rom_address - start_rom_address;
+
+    return true;
+}
+
+static void* compress_files_task(void* argument) {
+    CompressFilesTask* task = argument;
+
+    // Only allocated once per thread, not once per file.
+    u8* scratch_buffer = NULL;
+    if (task->cache != NULL) {
+        scratch_buffer = malloc(task->maximum_uncompressed_file_size > 0 ? task->maximum_uncompressed_file_size : 1);
+    }
+
+    while (true) {
+        pthread_mutex_lock(task->mutex);
+        size_t index = (*task->next_index)++;
+        pthread_mutex_unlock(task->mutex);
+
+        if (index >= (task->input_file_address_table->size - 1)) {
+            // The last entry in the table is only an end address.
+            break;
+        }
+
+        const FileAddressTableEntry* input_entry = (const FileAddressTableEntry*)(task->input_file_address_table->rom_addresses + index);
+        if ((input_entry->start_rom_address & 0x7FFFFFFF) > task->input_rom_buffer_size || (input_entry->end_rom_address & 0x7FFFFFFF) > task->input_rom_buffer_size) {
+            // Never happens, compress_files checks every file first.
+            continue;
+        }
+
+        CompressedFile* compressed_file = &task->compressed_files[index];
+        if (compressed_file->buffer == NULL) {
+            continue;
+        }
+
+        const u8* uncompressed_file_buffer = task->input_rom_buffer + (input_entry->start_rom_address & 0x7FFFFFFF);
+        size_t uncompressed_file_size = (input_entry->end_rom_address - input_entry->start_rom_address) & 0x7FFFFFFF;
+
+        compressed_file->hash = hash_buffer(uncompressed_file_buffer, uncompressed_file_size);
+
+        if (task->previous_pack != NULL && find_previous_file(task->previous_pack, index, uncompressed_file_size, compressed_file->hash, task->compression_type, &compressed_file->data, &compressed_file->size)) {
+            pthread_mutex_lock(task->mutex);
+            task->previous_pack->reused_file_count++;
+            pthread_mutex_unlock(task->mutex);
+
+            compressed_file->is_compressed = true;
+            continue;
+        }
+
+        u8* compressed_file_buffer = compressed_file->buffer;
+        size_t compressed_file_size = 0;
+
+        bool is_cached = task->cache != NULL && scratch_buffer != NULL && cache_load(task->cache, uncompressed_file_buffer, uncompressed_file_size, compressed_file->hash, task->compression_type, compressed_file_buffer, compressed_file->capacity, &compressed_file_size, scratch_buffer);
+
+        if (task->cache != NULL) {
+            pthread_mutex_lock(task->mutex);
+            if (is_cached) {
+                task->cache->hit_count++;
+            } else {
+                task->cache->miss_count++;
+            }
+            pthread_mutex_unlock(task->mutex);
+        }
+
+        if (!is_cached) {
+            // The compressors read straight from the ROM and write straight into the arena.
+            if (task->compression_type == COMPRESSION_TYPE_EFFICIENT) {
+                compressed_file_size = lzkn64_compress_efficient(uncompressed_file_buffer, compressed_file_buffer, uncompressed_file_size);
+            } else if (task->compression_type == COMPRESSION_TYPE_OPTIMAL) {
+                compressed_file_size = lzkn64_compress_optimal(uncompressed_file_buffer, compressed_file_buffer, uncompressed_file_size);
+            } else {
+                compressed_file_size = lzkn64_compress_accurate(uncompressed_file_buffer, compressed_file_buffer, uncompressed_file_size);
+            }
+
+            if (compressed_file_size == 0) {
+                // Even an empty file has a header, the compressor ran out of memory.
+                pthread_mutex_lock(task->mutex);
+                task->success = false;
+                pthread_mutex_unlock(task->mutex);
+                continue;
+            }
+
+            // Pad the file to a 2-byte boundary.
+            if (compressed_file_size & 1) {
+                compressed_file_buffer[compressed_file_size++] = 0;
+            }
+
+            if (task->cache != NULL) {
+                cache_store(task->cache, uncompressed_file_size, compressed_file->hash, task->compression_type, compressed_file_buffer, compressed_file_size);
+            }
+        }
+
+        compressed_file->data = compressed_file_buffer;
+        compressed_file->size = compressed_file_size;
+        compressed_file->is_compressed = true;
+    }
+
+    free(scratch_buffer);
+
+    return NULL;
+}
+
+// Compresses every file that needs it into its own slot of one arena, the files are independent so any number of threads can work on them.
+// The arena is only touched as far as the compressed data goes, so its size mostly costs address space.
+static CompressedFile* compress_files(const u8* input_rom_buffer, const FileAddressTable* input_file_address_table, const size_t input_rom_buffer_size, const CompressionType compression_type, CompressionCache* cache, PreviousPack* previous_pack, size_t thread_count, u8** arena) {
+    CompressedFile* compressed_files = calloc(input_file_address_table->size, sizeof(CompressedFile));
+    if (compressed_files == NULL) {
+        return NULL;
+    }
+
+    // Size the arena from the table, the last entry in the table is only an end address.
+    size_t arena_size = 0;
+    size_t maximum_uncompressed_file_size = 0;
+
+    for (size_t index = 0; (index + 1) < input_file_address_table->size; index++) {
+        const FileAddressTableEntry* input_entry = (const FileAddressTableEntry*)(input_file_address_table->rom_addresses + index);
+        if ((input_entry->start_rom_address & 0x7FFFFFFF) > input_rom_buffer_size || (input_entry->end_rom_address & 0x7FFFFFFF) > input_rom_buffer_size || (input_entry->end_rom_address & 0x7FFFFFFF) < (input_entry->start_rom_address & 0x7FFFFFFF)) {
+            // A missing file would give a shorter ROM, nothing is compressed.
+            free(compressed_files);
+            return NULL;
+        }
+
+        if (!should_compress_file(input_file_address_table, index)) {
+            continue;
+        }
+
+        size_t uncompressed_file_size = (input_entry->end_rom_address - input_entry->start_rom_address) & 0x7FFFFFFF;
+
+        compressed_files[index].capacity = LZKN64_COMPRESS_BOUND(uncompressed_file_size);
+        arena_size += compressed_files[index].capacity;
+
+        if (uncompressed_file_size > maximum_uncompressed_file_size) {
+            maximum_uncompressed_file_size = uncompressed_file_size;
+        }
+    }
+
+    *arena = malloc(arena_size > 0 ? arena_size : 1);
+    if (*arena == NULL) {
+        free(compressed_files);
+        return NULL;
+    }
+
+    size_t arena_offset = 0;
+    for (size_t index = 0; index < input_file_address_table->size; index++) {
+        if (compressed_files[index].capacity > 0) {
+            compressed_files[index].buffer = *arena + arena_offset;
+            arena_offset += compressed_files[index].capacity;
+        }
+    }
+
+    pthread_mutex_t mutex;
+    pthread_mutex_init(&mutex, NULL);
+    size_t next_index = 0;
+
+    CompressFilesTask task;
+    task.input_rom_buffer = input_rom_buffer;
+    task.input_file_address_table = input_file_address_table;
+    task.input_rom_buffer_size = input_rom_buffer_size;
+    task.compression_type = compression_type;
+    task.compressed_files = compressed_files;
+    task.cache = cache;
+    task.previous_pack = previous_pack;
+    task.maximum_uncompressed_file_size = maximum_uncompressed_file_size;
+    task.mutex = &mutex;
+    task.next_index = &next_index;
+    task.success = true;
+
+    run_on_threads(compress_files_task, &task, thread_count);
+
+    pthread_mutex_destroy(&mutex);
+
+    if (!task.success) {
+        free(compressed_files);
+        free(*arena);
+        *arena = NULL;
+        return NULL;
+    }
+
+    return compressed_files;
+}
+
+size_t rommy_compress(const u8* input_rom_buffer, u8* output_rom_buffer, const FileAddressTable* input_file_address_table, FileAddressTable* output_file_address_table, const size_t input_rom_buffer_size, const size_t output_rom_buffer_size, const CompressionType compression_type, CompressionCache* cache, PreviousPack* previous_pack, Manifest* pack_manifest, size_t thread_count) {
+    if (thread_count < 1) {
+        thread_count = 1;
+    }
+
+    u8* arena = NULL;
+    CompressedFile* compressed_files = compress_files(input_rom_buffer, input_file_address_table, input_rom_buffer_size, compression_type, cache, previous_pack, thread_count, &arena);
+    if (compressed_files == NULL) {
+        return 0;
+    }
+
+    // The files are laid out in table order, so the output doesn't depend on the number of threads.
     for (size_t index = 0; index < input_file_address_table->size; index++) {
         if (index == (input_file_address_table->size - 1)) {
             // Reached last entry in table (which is only an end address), break.
@@ -82,18 +473,20 @@ size_t rommy_compress(const u8* input_rom_buffer, u8* output_rom_buffer, const F
         const FileAddressTableEntry* input_entry = (const FileAddressTableEntry*)(input_file_address_table->rom_addresses + index);
         if ((input_entry->start_rom_address & 0x7FFFFFFF) > input_rom_buffer_size || (input_entry->end_rom_address & 0x7FFFFFFF) > input_rom_buffer_size) {
             // Something went wrong...
-            break;
+            free(compressed_files);
+            free(arena);
+            return 0;
         }
 
         FileAddressTableEntry* output_entry = (FileAddressTableEntry*)(output_file_address_table->rom_addresses + index);
         if ((output_entry->start_rom_address & 0x7FFFFFFF) > output_rom_buffer_size || (output_entry->end_rom_address & 0x7FFFFFFF) > output_rom_buffer_size) {
             // Something went wrong...
-            break;
+            free(compressed_files);
+            free(arena);
+            return 0;
         }
 
-        bool is_compressed = (input_entry->start_rom_address) >> 31;
-        bool is_empty_file = !((input_entry->end_rom_address - input_entry->start_rom_address) & 0x7FFFFFFF);
-        if (is_compressed || is_empty_file || !input_file_address_table->is_compressed_in_reference[index]) {
+        if (!should_compress_file(input_file_address_table, index)) {
             // File is already compressed, don't bother compressing but update entry.
             u32 compressed_file_size = (input_entry->end_rom_address - input_entry->start_rom_address) & 0x7FFFFFFF;
 
@@ -101,35 +494,104 @@ size_t rommy_compress(const u8* input_rom_buffer, u8* output_rom_buffer, const F
 
             // Don't need to set the bit here because the flag is already set.
             output_entry->end_rom_address = output_entry->start_rom_address + compressed_file_size;
+
+            if (pack_manifest != NULL) {
+                ManifestEntry* manifest_entry = &pack_manifest->entries[index];
+                manifest_entry->is_compressed = (input_entry->start_rom_address) >> 31;
+                manifest_entry->compressed_size = compressed_file_size;
+                manifest_entry->uncompressed_size = compressed_file_size;
+                manifest_entry->hash = hash_buffer(input_rom_buffer + (input_entry->start_rom_address & 0x7FFFFFFF), compressed_file_size);
+            }
             continue;
         }
 
-        size_t uncompressed_file_size = (input_entry->end_rom_address - input_entry->start_rom_address) & 0x7FFFFFFF;
-        u8* uncompressed_file_buffer = malloc(uncompressed_file_size);
+        const CompressedFile* compressed_file = &compressed_files[index];
+        if (!compressed_file->is_compressed) {
+            // Something went wrong...
+            free(compressed_files);
+            free(arena);
+            return 0;
+        }
 
-        memcpy(uncompressed_file_buffer, input_rom_buffer + (input_entry->start_rom_address & 0x7FFFFFFF), uncompressed_file_size);
+        memcpy(output_rom_buffer + (output_entry->start_rom_address & 0x7FFFFFFF), compressed_file->data, compressed_file->size);
 
-        size_t compressed_file_size = 0x4000000;
-        u8* compressed_file_buffer = malloc(compressed_file_size);
+        if (pack_manifest != NULL) {
+            ManifestEntry* manifest_entry = &pack_manifest->entries[index];
+            manifest_entry->is_compressed = true;
+            manifest_entry->has_compression_type = true;
+            manifest_entry->compression_type = compression_type;
+            manifest_entry->compressed_size = compressed_file->size;
+            manifest_entry->uncompressed_size = (input_entry->end_rom_address - input_entry->start_rom_address) & 0x7FFFFFFF;
+            manifest_entry->hash = compressed_file->hash;
+        }
 
-        compressed_file_size = lzkn64_compress_accurate(uncompressed_file_buffer, compressed_file_buffer, uncompressed_file_size);
+        output_entry->start_rom_address = output_entry->start_rom_address | (1 << 31);
+        output_entry->end_rom_address = (output_entry->start_rom_address & 0x7FFFFFFF) + compressed_file->size;
+    }
 
-        // Pad the file to a 2-byte boundary.
-        compressed_file_size = (compressed_file_size + 1) & ~1;
+    free(compressed_files);
+    free(arena);
 
-        memcpy(output_rom_buffer + (output_entry->start_rom_address & 0x7FFFFFFF), compressed_file_buffer, compressed_file_size);
+    if (cache != NULL) {
+        cache_trim(cache);
+    }
 
-        free(uncompressed_file_buffer);
-        free(compressed_file_buffer);
+    return output_file_address_table->rom_addresses[output_file_address_table->size - 1];
+}
 
-        output_entry->start_rom_address = output_entry->start_rom_address | (1 << 31);
-        output_entry->end_rom_address = (output_entry->start_rom_address & 0x7FFFFFFF) + compressed_file_size;
+static void* decompress_files_task(void* argument) {
+    DecompressFilesTask* task = argument;
+
+    while (true) {
+        pthread_mutex_lock(task->mutex);
+        size_t index = (*task->next_index)++;
+        pthread_mutex_unlock(task->mutex);
+
+        if (index >= task->file_count) {
+            break;
+        }
+
+        const DecompressedFile* file = &task->files[index];
+        u8* output_file_buffer = task->output_rom_buffer + file->output_rom_address;
+
+        if (file->needs_decoding) {
+            // Decompress straight into the final place in the output ROM, the size is already known.
+            size_t compressed_file_consumed = 0;
+            size_t decompressed_file_size = 0;
+            if (!lzkn64_decompress_checked(file->input_buffer, file->input_size, output_file_buffer, file->output_size, &compressed_file_consumed, &decompressed_file_size) || decompressed_file_size != file->output_size) {
+                pthread_mutex_lock(task->mutex);
+                task->success = false;
+                pthread_mutex_unlock(task->mutex);
+                continue;
+            }
+        } else {
+            memcpy(output_file_buffer, file->input_buffer, file->input_size);
+        }
+
+        if (task->manifest != NULL) {
+            task->manifest->entries[index].is_compressed = file->is_compressed;
+            task->manifest->entries[index].compressed_size = file->input_size;
+            task->manifest->entries[index].uncompressed_size = file->output_size;
+            task->manifest->entries[index].hash = hash_buffer(output_file_buffer, file->output_size);
+        }
     }
 
-    return output_file_address_table->rom_addresses[output_file_address_table->size - 1];
+    return NULL;
 }
 
-size_t rommy_decompress(const u8* input_rom_buffer, u8* output_rom_buffer, const FileAddressTable* input_file_address_table, FileAddressTable* output_file_address_table, const size_t input_rom_buffer_size, const size_t output_rom_buffer_size) {
+size_t rommy_decompress(const u8* input_rom_buffer, u8* output_rom_buffer, const FileAddressTable* input_file_address_table, FileAddressTable* output_file_address_table, const size_t input_rom_buffer_size, const size_t output_rom_buffer_size, Manifest* manifest, size_t thread_count) {
+    if (thread_count < 1) {
+        thread_count = 1;
+    }
+
+    DecompressedFile* files = calloc(input_file_address_table->size, sizeof(DecompressedFile));
+    if (files == NULL) {
+        return 0;
+    }
+
+    size_t file_count = 0;
+
+    // The first pass only reads the commands to get every decompressed size, which fixes where every file goes in the output ROM.
     for (size_t index = 0; index < input_file_address_table->size; index++) {
         if (index == (input_file_address_table->size - 1)) {
             // Reached last entry in table (which is only an end address), break.
@@ -139,46 +601,252 @@ size_t rommy_decompress(const u8* input_rom_buffer, u8* output_rom_buffer, const
         FileAddressTableEntry* input_entry = (FileAddressTableEntry*)(input_file_address_table->rom_addresses + index);
         if ((input_entry->start_rom_address & 0x7FFFFFFF) > input_rom_buffer_size || (input_entry->end_rom_address & 0x7FFFFFFF)  > input_rom_buffer_size) {
             // Something went wrong...
-            break;
+            free(files);
+            return 0;
         }
 
         FileAddressTableEntry* output_entry = (FileAddressTableEntry*)(output_file_address_table->rom_addresses + index);
         if ((output_entry->start_rom_address & 0x7FFFFFFF) > output_rom_buffer_size || (output_entry->end_rom_address & 0x7FFFFFFF) > output_rom_buffer_size) {
             // Something went wrong...
-            break;
+            free(files);
+            return 0;
         }
 
-        bool is_compressed = (input_entry->start_rom_address) >> 31;
-        bool is_empty_file = !((input_entry->end_rom_address - input_entry->start_rom_address) & 0x7FFFFFFF);
-        if (!is_compressed || is_empty_file) {
+        DecompressedFile* file = &files[index];
+        file->input_buffer = input_rom_buffer + (input_entry->start_rom_address & 0x7FFFFFFF);
+        file->input_size = (input_entry->end_rom_address - input_entry->start_rom_address) & 0x7FFFFFFF;
+        file->output_rom_address = output_entry->start_rom_address & 0x7FFFFFFF;
+        file->is_compressed = (input_entry->start_rom_address) >> 31;
+
+        bool is_empty_file = !file->input_size;
+        if (!file->is_compressed || is_empty_file) {
             // File is uncompressed, don't bother decompressing but update entry.
-            u32 uncompressed_file_size = (input_entry->end_rom_address - input_entry->start_rom_address) & 0x7FFFFFFF;
+            if (file->input_size > (output_rom_buffer_size - file->output_rom_address)) {
+                // Something went wrong...
+                free(files);
+                return 0;
+            }
 
-            memcpy(output_rom_buffer + output_entry->start_rom_address, input_rom_buffer + input_entry->start_rom_address, uncompressed_file_size);
+            file->output_size = file->input_size;
+            file_count = index + 1;
 
             // Don't need to mask the address here because the flag is already unset.
-            output_entry->end_rom_address = output_entry->start_rom_address + uncompressed_file_size;
+            output_entry->end_rom_address = output_entry->start_rom_address + file->output_size;
             continue;
         }
 
-        size_t compressed_file_size = (input_entry->end_rom_address - input_entry->start_rom_address) & 0x7FFFFFFF;
-        u8* compressed_file_buffer = malloc(compressed_file_size);
+        size_t decompressed_file_size = 0;
+        if (!lzkn64_decompressed_size(file->input_buffer, file->input_size, &decompressed_file_size) || decompressed_file_size > (output_rom_buffer_size - file->output_rom_address)) {
+            // Something went wrong...
+            free(files);
+            return 0;
+        }
 
-        memcpy(compressed_file_buffer, input_rom_buffer + (input_entry->start_rom_address & 0x7FFFFFFF), compressed_file_size);
+        file->needs_decoding = true;
+        file->output_size = decompressed_file_size;
+        file_count = index + 1;
 
-        size_t decompressed_file_size = 0x4000000;
-        u8* decompressed_file_buffer = malloc(decompressed_file_size);
+        output_entry->start_rom_address = output_entry->start_rom_address & 0x7FFFFFFF;
+        output_entry->end_rom_address = (output_entry->start_rom_address & 0x7FFFFFFF) + decompressed_file_size;
+    }
 
-        decompressed_file_size = lzkn64_decompress(compressed_file_buffer, decompressed_file_buffer, compressed_file_size);
+    // The second pass decodes the files, they don't depend on each other anymore so any number of threads can work on them.
+    pthread_mutex_t mutex;
+    pthread_mutex_init(&mutex, NULL);
+    size_t next_index = 0;
 
-        memcpy(output_rom_buffer + (output_entry->start_rom_address & 0x7FFFFFFF), decompressed_file_buffer, decompressed_file_size);
+    DecompressFilesTask task;
+    task.files = files;
+    task.file_count = file_count;
+    task.output_rom_buffer = output_rom_buffer;
+    task.manifest = manifest;
+    task.mutex = &mutex;
+    task.next_index = &next_index;
+    task.success = true;
 
-        free(compressed_file_buffer);
-        free(decompressed_file_buffer);
+    run_on_threads(decompress_files_task, &task, thread_count);
 
-        output_entry->start_rom_address = output_entry->start_rom_address & 0x7FFFFFFF;
-        output_entry->end_rom_address = (output_entry->start_rom_address & 0x7FFFFFFF) + decompressed_file_size;
+    pthread_mutex_destroy(&mutex);
+
+    free(files);
+
+    if (!task.success) {
+        return 0;
     }
 
     return output_file_address_table->rom_addresses[output_file_address_table->size - 1];
-}
\ No newline at end of file
+}
+
+// Makes sure the buffer has at least the given size, keeps it if it's big enough already.
+static bool reserve_buffer(u8** buffer, size_t* capacity, size_t size) {
+    if (size <= *capacity) {
+        return true;
+    }
+
+    u8* new_buffer = realloc(*buffer, size);
+    if (new_buffer == NULL) {
+        return false;
+    }
+
+    *buffer = new_buffer;
+    *capacity = size;
+
+    return true;
+}
+
+static VerifyStatus verify_file(const VerifyFilesTask* task, const size_t index, VerifiedFile* verified_file, u8** decompressed_buffer, size_t* decompressed_capacity, u8** compressed_buffer, size_t* compressed_capacity, bool* success) {
+    RommyEntry entry;
+    if (!rommy_get_entry(task->rom_buffer, task->file_address_table, task->rom_buffer_size, index, &entry)) {
+        return VERIFY_STATUS_INVALID_ADDRESS;
+    }
+
+    verified_file->is_compressed = entry.is_compressed;
+    verified_file->compressed_size = entry.size;
+    verified_file->uncompressed_size = entry.size;
+
+    // Empty files are marked as compressed, but they don't contain any data.
+    const u8* uncompressed_file_buffer = entry.data;
+    if (entry.is_compressed && entry.size > 0) {
+        size_t uncompressed_file_size = 0;
+        if (!rommy_get_entry_uncompressed_size(&entry, &uncompressed_file_size)) {
+            return VERIFY_STATUS_DECOMPRESSION_FAILED;
+        }
+
+        if (!reserve_buffer(decompressed_buffer, decompressed_capacity, uncompressed_file_size > 0 ? uncompressed_file_size : 1) || !reserve_buffer(compressed_buffer, compressed_capacity, LZKN64_COMPRESS_BOUND(uncompressed_file_size))) {
+            *success = false;
+            return VERIFY_STATUS_DECOMPRESSION_FAILED;
+        }
+
+        size_t decompressed_file_size = 0;
+        if (!rommy_decode_entry(&entry, *decompressed_buffer, uncompressed_file_size, &decompressed_file_size) || decompressed_file_size != uncompressed_file_size) {
+            return VERIFY_STATUS_DECOMPRESSION_FAILED;
+        }
+
+        verified_file->uncompressed_size = uncompressed_file_size;
+        uncompressed_file_buffer = *decompressed_buffer;
+
+        CompressionType compression_type = task->compression_type;
+        if (task->manifest != NULL && task->manifest->entries[index].has_compression_type) {
+            compression_type = task->manifest->entries[index].compression_type;
+        }
+
+        size_t compressed_file_size = 0;
+        if (compression_type == COMPRESSION_TYPE_EFFICIENT) {
+            compressed_file_size = lzkn64_compress_efficient(uncompressed_file_buffer, *compressed_buffer, uncompressed_file_size);
+        } else if (compression_type == COMPRESSION_TYPE_OPTIMAL) {
+            compressed_file_size = lzkn64_compress_optimal(uncompressed_file_buffer, *compressed_buffer, uncompressed_file_size);
+        } else {
+            compressed_file_size = lzkn64_compress_accurate(uncompressed_file_buffer, *compressed_buffer, uncompressed_file_size);
+        }
+
+        // Files are padded to a 2-byte boundary in the ROM.
+        if (compressed_file_size & 1) {
+            (*compressed_buffer)[compressed_file_size++] = 0;
+        }
+
+        if (compressed_file_size != entry.size || memcmp(*compressed_buffer, entry.data, entry.size) != 0) {
+            return VERIFY_STATUS_RECOMPRESSION_MISMATCH;
+        }
+    }
+
+    if (task->manifest != NULL) {
+        const ManifestEntry* manifest_entry = &task->manifest->entries[index];
+        if (manifest_entry->is_compressed != entry.is_compressed || manifest_entry->compressed_size != entry.size || manifest_entry->uncompressed_size != verified_file->uncompressed_size || manifest_entry->hash != hash_buffer(uncompressed_file_buffer, verified_file->uncompressed_size)) {
+            return VERIFY_STATUS_MANIFEST_MISMATCH;
+        }
+    }
+
+    if (task->reference_rom_buffer != NULL) {
+        RommyEntry reference_entry;
+        if (!rommy_get_entry(task->reference_rom_buffer, task->reference_file_address_table, task->reference_rom_buffer_size, index, &reference_entry)) {
+            return VERIFY_STATUS_REFERENCE_MISMATCH;
+        }
+
+        if (reference_entry.is_compressed != entry.is_compressed || reference_entry.size != entry.size || memcmp(reference_entry.data, entry.data, entry.size) != 0) {
+            return VERIFY_STATUS_REFERENCE_MISMATCH;
+        }
+    }
+
+    return VERIFY_STATUS_MATCH;
+}
+
+static void* verify_files_task(void* argument) {
+    VerifyFilesTask* task = argument;
+
+    // Grown as needed and only allocated once per thread, not once per file.
+    u8* decompressed_buffer = NULL;
+    size_t decompressed_capacity = 0;
+    u8* compressed_buffer = NULL;
+    size_t compressed_capacity = 0;
+
+    while (true) {
+        pthread_mutex_lock(task->mutex);
+        size_t index = (*task->next_index)++;
+        pthread_mutex_unlock(task->mutex);
+
+        if (index >= (task->file_address_table->size - 1)) {
+            // The last entry in the table is only an end address.
+            break;
+        }
+
+        struct timespec start_time;
+        struct timespec end_time;
+        clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+        bool success = true;
+        VerifiedFile* verified_file = &task->verified_files[index];
+        verified_file->status = verify_file(task, index, verified_file, &decompressed_buffer, &decompressed_capacity, &compressed_buffer, &compressed_capacity, &success);
+
+        clock_gettime(CLOCK_MONOTONIC, &end_time);
+        verified_file->time = (double)(end_time.tv_sec - start_time.tv_sec) + (double)(end_time.tv_nsec - start_time.tv_nsec) / 1000000000.0;
+
+        if (!success) {
+            pthread_mutex_lock(task->mutex);
+            task->success = false;
+            pthread_mutex_unlock(task->mutex);
+        }
+    }
+
+    free(decompressed_buffer);
+    free(compressed_buffer);
+
+    return NULL;
+}
+
+bool rommy_verify(const u8* rom_buffer, const FileAddressTable* file_address_table, const size_t rom_buffer_size, const Manifest* manifest, const u8* reference_rom_buffer, const FileAddressTable* reference_file_address_table, const size_t reference_rom_buffer_size, const CompressionType compression_type, VerifiedFile* verified_files, size_t thread_count) {
+    if (thread_count < 1) {
+        thread_count = 1;
+    }
+
+    if ((manifest != NULL && manifest->size != file_address_table->size) || (reference_rom_buffer != NULL && reference_file_address_table->size != file_address_table->size)) {
+        // Written for a different ROM.
+        return false;
+    }
+
+    memset(verified_files, 0, (file_address_table->size - 1) * sizeof(VerifiedFile));
+
+    // Every file is checked on its own, so any number of threads can work on them.
+    pthread_mutex_t mutex;
+    pthread_mutex_init(&mutex, NULL);
+    size_t next_index = 0;
+
+    VerifyFilesTask task;
+    task.rom_buffer = rom_buffer;
+    task.file_address_table = file_address_table;
+    task.rom_buffer_size = rom_buffer_size;
+    task.manifest = manifest;
+    task.reference_rom_buffer = reference_rom_buffer;
+    task.reference_file_address_table = reference_file_address_table;
+    task.reference_rom_buffer_size = reference_rom_buffer_size;
+    task.compression_type = compression_type;
+    task.verified_files = verified_files;
+    task.mutex = &mutex;
+    task.next_index = &next_index;
+    task.success = true;
+
+    run_on_threads(verify_files_task, &task, thread_count);
+
+    pthread_mutex_destroy(&mutex);
+
+    return task.success;
+}
@@ -3,10 +3,76 @@
 
 #include "types.h"
 #include "structs.h"
+#include "cache.h"
+#include "manifest.h"
+
+// The ROM the last compression wrote and its pack manifest, files that haven't changed since then are taken from it.
+typedef struct {
+    const u8* rom_buffer;
+    size_t rom_buffer_size;
+    const FileAddressTable* file_address_table; // Has to have the same size as the input table.
+    const Manifest* manifest;
+    size_t reused_file_count;
+} PreviousPack;
+
+// One file of a ROM, taken straight from the file address table.
+typedef struct {
+    size_t index; // Index of the file in the game's table, the first file is 0.
+    bool is_compressed;
+    u32 start_rom_address; // Without the compression flag.
+    u32 end_rom_address;
+    const u8* data; // Points into the ROM, nothing is copied.
+    size_t size; // Size of the file in the ROM, compressed or not.
+} RommyEntry;
+
+// Walks over the files of a ROM in table order.
+typedef struct {
+    const u8* rom_buffer;
+    size_t rom_buffer_size;
+    const FileAddressTable* file_address_table;
+    size_t next_index;
+} RommyIterator;
+
+typedef enum {
+    VERIFY_STATUS_MATCH,
+    VERIFY_STATUS_INVALID_ADDRESS, // The file lies outside of the ROM.
+    VERIFY_STATUS_DECOMPRESSION_FAILED,
+    VERIFY_STATUS_RECOMPRESSION_MISMATCH, // Compressing the decompressed file again doesn't give the bytes in the ROM.
+    VERIFY_STATUS_MANIFEST_MISMATCH,
+    VERIFY_STATUS_REFERENCE_MISMATCH
+} VerifyStatus;
+
+typedef struct {
+    bool is_compressed;
+    size_t compressed_size; // Size of the file in the ROM, compressed or not.
+    size_t uncompressed_size;
+    VerifyStatus status;
+    double time; // Seconds spent on the file.
+} VerifiedFile;
 
 bool rommy_read_file_address_table(const u8* input_rom_buffer, const u8* reference_rom_buffer, FileAddressTable* file_address_table, const size_t input_rom_buffer_size, const size_t reference_rom_buffer_size, const size_t file_address_table_rom_address);
+// Takes which files are compressed from a manifest instead of a reference ROM.
+bool rommy_apply_manifest(FileAddressTable* file_address_table, const Manifest* manifest);
+void rommy_free_file_address_table(FileAddressTable* file_address_table);
 bool rommy_write_file_address_table(const u8* input_rom_buffer, const FileAddressTable* file_address_table, const size_t input_rom_buffer_size, const size_t file_address_table_rom_address);
-size_t rommy_compress(const u8* input_rom_buffer, u8* output_rom_buffer, const FileAddressTable* input_file_address_table, FileAddressTable* output_file_address_table, const size_t input_rom_buffer_size, const size_t output_rom_buffer_size);
-size_t rommy_decompress(const u8* input_rom_buffer, u8* output_rom_buffer, const FileAddressTable* input_file_address_table, FileAddressTable* output_file_address_table, const size_t input_rom_buffer_size, const size_t output_rom_buffer_size);
+size_t rommy_compress(const u8* input_rom_buffer, u8* output_rom_buffer, const FileAddressTable* input_file_address_table, FileAddressTable* output_file_address_table, const size_t input_rom_buffer_size, const size_t output_rom_buffer_size, const CompressionType compression_type, CompressionCache* cache, PreviousPack* previous_pack, Manifest* pack_manifest, size_t thread_count);
+size_t rommy_decompress(const u8* input_rom_buffer, u8* output_rom_buffer, const FileAddressTable* input_file_address_table, FileAddressTable* output_file_address_table, const size_t input_rom_buffer_size, const size_t output_rom_buffer_size, Manifest* manifest, size_t thread_count);
+
+// The last entry of the table is only an end address, so there is one file less than there are entries.
+size_t rommy_get_entry_count(const FileAddressTable* file_address_table);
+// Returns false if there is no such file or if it lies outside of the ROM.
+bool rommy_get_entry(const u8* rom_buffer, const FileAddressTable* file_address_table, const size_t rom_buffer_size, const size_t index, RommyEntry* entry);
+void rommy_iterator_initialize(RommyIterator* iterator, const u8* rom_buffer, const FileAddressTable* file_address_table, const size_t rom_buffer_size);
+// Returns false after the last file, or at the first file that lies outside of the ROM.
+bool rommy_iterator_next(RommyIterator* iterator, RommyEntry* entry);
+// Only reads the commands of compressed files, without decompressing anything.
+bool rommy_get_entry_uncompressed_size(const RommyEntry* entry, size_t* uncompressed_size);
+// Decompresses the file into the output buffer, or copies it if it isn't compressed.
+// Returns false if the file is invalid or doesn't fit into the output capacity.
+bool rommy_decode_entry(const RommyEntry* entry, u8* output_buffer, const size_t output_capacity, size_t* output_size);
+
+// Checks every file of a compressed ROM, the result for each file is stored in verified_files (one less than the size of the table).
+// Compressed files are decompressed and compressed again, the manifest and the reference ROM are optional.
+bool rommy_verify(const u8* rom_buffer, const FileAddressTable* file_address_table, const size_t rom_buffer_size, const Manifest* manifest, const u8* reference_rom_buffer, const FileAddressTable* reference_file_address_table, const size_t reference_rom_buffer_size, const CompressionType compression_type, VerifiedFile* verified_files, size_t thread_count);
 
 #endif // ROMMY_H
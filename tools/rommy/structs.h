@@ -8,6 +8,14 @@ typedef struct {
     u32 end_rom_address;
 } FileAddressTableEntry;
 
+typedef enum {
+    COMPRESSION_TYPE_ACCURATE,
+    COMPRESSION_TYPE_EFFICIENT,
+    COMPRESSION_TYPE_OPTIMAL
+} CompressionType;
+
+// The start address of every file as it is in the ROM, file N goes from rom_addresses[N] to rom_addresses[N + 1].
+// The last address is only the end of the last file, so there is one file less than the size.
 typedef struct {
     size_t size;
     u32* rom_addresses;
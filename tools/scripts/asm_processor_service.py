@@ -0,0 +1,235 @@
+# Compiles GLOBAL_ASM files through asm-processor without starting and importing asm-processor again for every file.
+# Takes the same arguments as tools/asm-processor/build.py, after the path of a socket:
+#   asm_processor_service.py <socket> <compiler> -- <assembler> -- <compiler flags> -o <object> <source>
+# The first call starts a service on the socket, which keeps asm_processor and build.py loaded and forks once per file,
+# so files from make -j are still compiled at the same time. Output goes straight to the caller's stdout and stderr.
+# The service quits after IDLE_TIMEOUT seconds without a file, or when asm-processor or this script changes.
+# If the service can't be reached, the file is compiled by build.py like before.
+import json
+import os
+import socket
+import struct
+import sys
+import time
+
+ASM_PROCESSOR_DIR = os.path.join(os.path.dirname(os.path.dirname(os.path.abspath(__file__))), "asm-processor")
+BUILD_PY = os.path.join(ASM_PROCESSOR_DIR, "build.py")
+
+IDLE_TIMEOUT = 60
+START_TIMEOUT = 10
+
+# The exit code of a service that couldn't load asm-processor, the caller falls back to build.py straight away.
+EXIT_LOAD_FAILED = 2
+
+def source_files():
+    return [os.path.abspath(__file__), BUILD_PY, os.path.join(ASM_PROCESSOR_DIR, "asm_processor.py")]
+
+def modification_times():
+    return [os.stat(path).st_mtime_ns for path in source_files()]
+
+def receive_exactly(connection, size):
+    data = b""
+
+    while len(data) < size:
+        chunk = connection.recv(size - len(data))
+
+        if not chunk:
+            raise ConnectionError("connection closed")
+
+        data += chunk
+
+    return data
+
+def compile_file(connection, build_py_code):
+    # The header is sent together with the caller's stdout and stderr.
+    header, fds, _, _ = socket.recv_fds(connection, 4, 2)
+
+    if len(header) < 4:
+        header += receive_exactly(connection, 4 - len(header))
+
+    (length,) = struct.unpack(">I", header)
+    request = json.loads(receive_exactly(connection, length))
+
+    os.chdir(request["cwd"])
+    os.environ.clear()
+    os.environ.update(request["environ"])
+
+    devnull = os.open(os.devnull, os.O_RDONLY)
+    os.dup2(devnull, 0)
+    os.dup2(fds[0], 1)
+    os.dup2(fds[1], 2)
+
+    sys.argv = [BUILD_PY] + request["argv"]
+
+    try:
+        exec(build_py_code, {"__name__": "__main__", "__file__": BUILD_PY})
+        status = 0
+    except SystemExit as e:
+        status = e.code if isinstance(e.code, int) else (0 if e.code is None else 1)
+    except BaseException:
+        import traceback
+        traceback.print_exc()
+        status = 1
+
+    sys.stdout.flush()
+    sys.stderr.flush()
+
+    connection.sendall(struct.pack(">i", status))
+
+def serve(socket_path):
+    import fcntl
+    import signal
+
+    # Only one service per socket, the others started by the same make -j quit and their callers connect to this one.
+    # Waits a little in case the service before is just quitting.
+    lock = open(socket_path + ".lock", "w")
+    deadline = time.monotonic() + 1
+
+    while True:
+        try:
+            fcntl.flock(lock, fcntl.LOCK_EX | fcntl.LOCK_NB)
+            break
+        except OSError:
+            if time.monotonic() >= deadline:
+                return 0
+
+            time.sleep(0.01)
+
+    try:
+        sys.path.insert(0, ASM_PROCESSOR_DIR)
+
+        # Everything build.py imports, so the forked processes only have to run it.
+        import asm_processor
+        import shlex
+        import subprocess
+        import tempfile
+        import pathlib
+
+        times = modification_times()
+
+        with open(BUILD_PY) as file:
+            build_py_code = compile(file.read(), BUILD_PY, "exec")
+    except Exception:
+        return EXIT_LOAD_FAILED
+
+    if os.path.exists(socket_path):
+        os.unlink(socket_path)
+
+    listener = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    listener.bind(socket_path)
+    listener.listen(64)
+    listener.settimeout(IDLE_TIMEOUT)
+
+    # Finished processes are reaped by the kernel.
+    signal.signal(signal.SIGCHLD, signal.SIG_IGN)
+
+    try:
+        while True:
+            try:
+                connection, _ = listener.accept()
+            except socket.timeout:
+                break
+
+            # Closing the connection without an exit code makes the caller use build.py, the next file starts a new service.
+            try:
+                changed = modification_times() != times
+            except OSError:
+                changed = True
+
+            if changed:
+                connection.close()
+                break
+
+            connection.setblocking(True)
+
+            if os.fork() == 0:
+                listener.close()
+                lock.close()
+                signal.signal(signal.SIGCHLD, signal.SIG_DFL)
+
+                try:
+                    compile_file(connection, build_py_code)
+                finally:
+                    os._exit(0)
+
+            connection.close()
+    finally:
+        listener.close()
+
+        try:
+            os.unlink(socket_path)
+        except OSError:
+            pass
+
+        lock.close()
+
+    return 0
+
+def connect(socket_path):
+    connection = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+
+    try:
+        connection.connect(socket_path)
+    except OSError:
+        connection.close()
+        return None
+
+    return connection
+
+def start_service(socket_path):
+    import subprocess
+
+    os.makedirs(os.path.dirname(socket_path) or ".", exist_ok=True)
+
+    service = subprocess.Popen([sys.executable, os.path.abspath(__file__), "--serve", socket_path],
+                               stdin=subprocess.DEVNULL, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL,
+                               start_new_session=True)
+
+    deadline = time.monotonic() + START_TIMEOUT
+
+    while time.monotonic() < deadline:
+        connection = connect(socket_path)
+
+        if connection is not None:
+            return connection
+
+        if service.poll() == EXIT_LOAD_FAILED:
+            return None
+
+        time.sleep(0.01)
+
+    return None
+
+def request(connection, argv):
+    payload = json.dumps({"argv": argv, "cwd": os.getcwd(), "environ": dict(os.environ)}).encode()
+
+    sys.stdout.flush()
+    sys.stderr.flush()
+
+    try:
+        socket.send_fds(connection, [struct.pack(">I", len(payload)) + payload], [1, 2])
+        (status,) = struct.unpack(">i", receive_exactly(connection, 4))
+    except OSError:
+        return None
+    finally:
+        connection.close()
+
+    return status
+
+def main():
+    if sys.argv[1] == "--serve":
+        return serve(sys.argv[2])
+
+    socket_path = sys.argv[1]
+    argv = sys.argv[2:]
+
+    connection = connect(socket_path) or start_service(socket_path)
+    status = None if connection is None else request(connection, argv)
+
+    if status is None:
+        os.execv(sys.executable, [sys.executable, BUILD_PY] + argv)
+
+    return status
+
+if __name__ == '__main__':
+    sys.exit(main())
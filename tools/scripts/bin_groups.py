@@ -0,0 +1,177 @@
+# Assembles the .bin files of segments that are nothing but .bin files (like the databin segments) with .incbin, all of
+# an output section's files in one object, instead of running ld -r -b binary once for every file.
+#   bin_groups.py <linker script> <build directory> <makefile>
+# Writes <build directory>/bin_groups/<output section>.s, <build directory>/bin_groups/<linker script>, which is the linker
+# script with every grouped object replaced by the section of the file in its group's object, and a makefile that lists
+# the grouped files and what each group depends on.
+import os
+import re
+import sys
+
+# Few enough files per group that make -j can still share out an output section with a lot of them.
+FILES_PER_GROUP = 64
+
+# An output section, like ".file_1 0x5000000 : AT(file_1_ROM_START) SUBALIGN(16)".
+OUTPUT_SECTION = re.compile(r"^\s*\.([A-Za-z_][\w.]*)[^=]*:")
+
+# An object's input section, like "build/us/assets/us/file_1/576E00.bin.o(.data);".
+INPUT_SECTION = re.compile(r"^(\s*)(\S+\.o)\(([^()\s]+)\);\s*$")
+
+def write_changed(path, data):
+    # Unchanged files keep their modification time, so only groups that actually changed are assembled again.
+    try:
+        with open(path) as file:
+            if file.read() == data:
+                return
+    except OSError:
+        pass
+
+    with open(path + ".tmp", "w") as file:
+        file.write(data)
+
+    os.replace(path + ".tmp", path)
+
+def binary_name(path):
+    # The name ld -b binary gives the symbols of a file, like _binary_assets_us_file_1_576E00_bin_start.
+    return re.sub(r"[^A-Za-z0-9]", "_", path)
+
+def read_output_sections(lines):
+    # Returns the output section of every line, None outside of them.
+    sections = []
+    depth = 0
+    header = None
+    section = None
+
+    for line in lines:
+        if depth == 1 and (match := OUTPUT_SECTION.match(line)) is not None:
+            header = match.group(1)
+
+        depth += line.count("{") - line.count("}")
+
+        if depth == 2 and header is not None:
+            section = header
+            header = None
+        elif depth < 2:
+            section = None
+
+        sections.append(section)
+
+    return sections
+
+def main():
+    linker_script_path, build_directory, makefile_path = sys.argv[1:4]
+
+    with open(linker_script_path) as file:
+        lines = file.readlines()
+
+    sections = read_output_sections(lines)
+
+    # Output sections with only .data of .bin objects, and how often each object is mentioned anywhere.
+    only_binaries = {}
+    mentions = {}
+
+    for line, section in zip(lines, sections):
+        for path in re.findall(r"(\S+\.o)\s*\(", line):
+            mentions[path] = mentions.get(path, 0) + 1
+
+        match = INPUT_SECTION.match(line)
+
+        if match is None or section is None:
+            continue
+
+        _, path, input_section = match.groups()
+        is_binary = path.startswith(build_directory + "/") and path.endswith(".bin.o") and input_section == ".data"
+        only_binaries[section] = only_binaries.get(section, True) and is_binary
+
+    # Files mentioned once, so moving them into a group never links one twice, in the order of the linker script.
+    # A group never takes files from more than one output section, so it always belongs to a single segment and
+    # tools/scripts/partial_link.py can still link every overlay segment on its own.
+    grouped = {}
+
+    for line, section in zip(lines, sections):
+        match = INPUT_SECTION.match(line)
+
+        if match is not None and section is not None and only_binaries[section] and mentions[match.group(2)] == 1:
+            grouped.setdefault(section, []).append(match.group(2))
+
+    group_directory = os.path.join(build_directory, "bin_groups")
+    os.makedirs(group_directory, exist_ok=True)
+
+    group_of = {}
+    groups = []
+
+    for section, paths in grouped.items():
+        for start in range(0, len(paths), FILES_PER_GROUP):
+            # Named after the output section, so a group keeps its name and its object when other sections change.
+            group = os.path.join(group_directory, section if len(paths) <= FILES_PER_GROUP else f"{section}.{start // FILES_PER_GROUP}")
+            files = [path[len(build_directory) + 1:-len(".o")] for path in paths[start:start + FILES_PER_GROUP]]
+
+            # Every file gets its own section, so the linker script still places and aligns each of them on its own.
+            # Named sections start out aligned to 1 byte and aren't padded, even by MIPS gas, which only aligns and pads
+            # .text, .data and .bss to 16 bytes. That's the same as the .data of ld -b binary, so SIZEOF is unchanged.
+            assembly = "# Written by tools/scripts/bin_groups.py, don't edit.\n"
+
+            for file in files:
+                name = binary_name(file)
+                group_of[f"{build_directory}/{file}.o"] = (group, name)
+
+                assembly += f"\n.section .data.{name}, \"aw\"\n"
+                assembly += f".global _binary_{name}_start\n"
+                assembly += f".global _binary_{name}_end\n"
+                assembly += f".global _binary_{name}_size\n"
+                assembly += f"_binary_{name}_start:\n"
+                assembly += f".incbin \"{file}\"\n"
+                assembly += f"_binary_{name}_end:\n"
+                assembly += f".set _binary_{name}_size, _binary_{name}_end - _binary_{name}_start\n"
+
+            write_changed(group + ".s", assembly)
+            groups.append((group, files))
+
+    grouped_script = ""
+
+    for line in lines:
+        match = INPUT_SECTION.match(line)
+
+        if match is not None and match.group(2) in group_of:
+            group, name = group_of[match.group(2)]
+            grouped_script += f"{match.group(1)}{group}.o(.data.{name});\n"
+        else:
+            grouped_script += line
+
+    grouped_script_path = os.path.join(group_directory, os.path.basename(linker_script_path))
+    write_changed(grouped_script_path, grouped_script)
+
+    generated = [grouped_script_path] + [group + ".s" for group, _ in groups]
+
+    # Always written, so it's never older than the files it depends on.
+    with open(makefile_path + ".tmp", "w") as output:
+        output.write("# Written by tools/scripts/bin_groups.py, don't edit.\n\n")
+        output.write("GROUPED_BIN_FILES :=")
+
+        for _, files in groups:
+            for file in files:
+                output.write(f" \\\n    {file}")
+
+        output.write("\n\nBIN_GROUP_O_FILES :=")
+
+        for group, _ in groups:
+            output.write(f" \\\n    {group}.o")
+
+        output.write("\n")
+
+        for group, files in groups:
+            output.write(f"\n{group}.o:")
+
+            for file in files:
+                output.write(f" \\\n    {file}")
+
+            output.write("\n")
+
+        # Like the file list, a generated file that was deleted makes this be written again instead of failing.
+        output.write(f"\n{makefile_path}: {' '.join(generated)}\n")
+        output.write(f"\n{' '.join(generated)}: ;\n")
+
+    os.replace(makefile_path + ".tmp", makefile_path)
+
+if __name__ == '__main__':
+    main()
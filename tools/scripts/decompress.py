@@ -127,14 +127,12 @@ def decompress_get_len(input, sizeCompressed):
         inPos += 1
 
         if curCmd < 0x80:  # Sliding window lookback and copy with length.
-            for _ in range(2 + (curCmd >> 2)):
-                bufPos += 1
+            bufPos += 2 + (curCmd >> 2)
             inPos += 1
 
         elif curCmd < 0xA0:  # Raw data copy with length.
-            for _ in range(curCmd & 0x1F):
-                bufPos += 1
-                inPos += 1
+            bufPos += curCmd & 0x1F
+            inPos += curCmd & 0x1F
 
         elif curCmd <= 0xFF:  # Write specific byte for length.
             length = 2 + (curCmd & 0x1F)
@@ -145,8 +143,7 @@ def decompress_get_len(input, sizeCompressed):
             elif curCmd < 0xE0:
                 inPos += 1
 
-            for _ in range(length):
-                bufPos += 1
+            bufPos += length
 
         else:
             inPos += 1
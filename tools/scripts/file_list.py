@@ -0,0 +1,77 @@
+# Writes the lists of source files the Makefile builds as a makefile, so they don't have to be searched for on every make.
+# The written makefile depends on every directory and every file in src, so it's only written again when files are added,
+# removed or renamed, or when a file in src changes (because it might start or stop using GLOBAL_ASM).
+import os
+import sys
+
+def find_directories(root, excluded_prefix=None):
+    directories = []
+
+    for directory, subdirectories, _ in os.walk(root):
+        if excluded_prefix is not None and directory.startswith(excluded_prefix):
+            subdirectories.clear()
+            continue
+
+        directories.append(directory)
+        subdirectories.sort()
+
+    return directories
+
+def find_files(directories, extension):
+    files = []
+
+    for directory in directories:
+        files.extend(sorted(os.path.join(directory, name) for name in os.listdir(directory) if name.endswith(extension) and not name.startswith(".") and os.path.isfile(os.path.join(directory, name))))
+
+    return files
+
+def uses_global_asm(path):
+    with open(path, "rb") as file:
+        return b"GLOBAL_ASM" in file.read()
+
+def write_variable(output, name, values):
+    output.write(f"{name} :=")
+
+    for value in values:
+        output.write(f" \\\n    {value}")
+
+    output.write("\n\n")
+
+def main():
+    version = sys.argv[1]
+    file_list = sys.argv[2]
+
+    bin_directories = find_directories(f"assets/{version}")
+    asm_directories = find_directories("asm", f"asm/{version}/nonmatchings")
+    src_directories = find_directories("src")
+
+    src_files = find_files(src_directories, "")
+    global_asm_c_files = sorted(path for path in src_files if uses_global_asm(path))
+
+    # Written to a temporary file first, so an interrupted make never leaves a half written list behind.
+    with open(file_list + ".tmp", "w") as output:
+        output.write("# Written by tools/scripts/file_list.py, don't edit.\n\n")
+
+        write_variable(output, "BIN_FILES", find_files(bin_directories, ".bin"))
+        write_variable(output, "S_FILES", find_files(asm_directories, ".s"))
+        write_variable(output, "C_FILES", find_files(src_directories, ".c"))
+        write_variable(output, "GLOBAL_ASM_C_FILES", global_asm_c_files)
+
+        dependencies = bin_directories + asm_directories + src_directories + src_files
+
+        output.write(f"{file_list}:")
+
+        for path in dependencies:
+            output.write(f" \\\n    {path}")
+
+        output.write("\n")
+
+        # Like gcc -MP, so a directory or file that was deleted makes the list be written again instead of failing.
+        # The empty recipe keeps make from searching its built-in implicit rules for every path, which is slow with this many.
+        for path in dependencies:
+            output.write(f"\n{path}: ;\n")
+
+    os.replace(file_list + ".tmp", file_list)
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,214 @@
+# Serves objects of earlier IDO compiles from a cache directory instead of compiling again, for example after a make clean
+# or when switching back to a branch.
+#   ido_cache.py <cache directory> <compiler> <compiler flags> -c -o <object> <source>
+#   ido_cache.py --stats <cache directory>
+#   ido_cache.py --zero-stats <cache directory>
+# An object is found by a hash of the preprocessed source, the compiler flags and every file next to the compiler.
+# Warnings are stored with the object and printed again. Entries are written to a temporary file and renamed, and the
+# statistics are updated under a lock, so make -j can use the same cache from any number of processes.
+import fcntl
+import hashlib
+import json
+import os
+import struct
+import subprocess
+import sys
+import tempfile
+
+# Part of every hash, changing it makes every entry from before a miss.
+CACHE_VERSION = b"ido_cache 1"
+
+STATISTICS = ["hits", "misses", "uncacheable"]
+
+def update_statistics(cache_directory, name):
+    fd = os.open(os.path.join(cache_directory, "stats"), os.O_RDWR | os.O_CREAT, 0o644)
+
+    try:
+        fcntl.flock(fd, fcntl.LOCK_EX)
+
+        data = os.read(fd, 4096)
+        statistics = json.loads(data) if data else {}
+        statistics[name] = statistics.get(name, 0) + 1
+
+        os.lseek(fd, 0, os.SEEK_SET)
+        os.ftruncate(fd, 0)
+        os.write(fd, json.dumps(statistics).encode())
+    finally:
+        os.close(fd)
+
+def write_file(path, data):
+    temporary_path = f"{path}.{os.getpid()}.tmp"
+
+    with open(temporary_path, "wb") as file:
+        file.write(data)
+
+    os.replace(temporary_path, path)
+
+def compiler_digest(cache_directory, compiler):
+    # Hashing every compiler binary on every compile would take longer than a cache hit, so the hash is kept
+    # along with the size and modification time of each file and only computed again when one of them changes.
+    compiler_directory = os.path.dirname(os.path.abspath(compiler))
+    stamp = []
+
+    for name in sorted(os.listdir(compiler_directory)):
+        stat = os.stat(os.path.join(compiler_directory, name))
+        stamp.append([name, stat.st_size, stat.st_mtime_ns])
+
+    digests_path = os.path.join(cache_directory, "compilers")
+
+    try:
+        with open(digests_path) as file:
+            digests = json.load(file)
+    except (OSError, ValueError):
+        digests = {}
+
+    entry = digests.get(compiler_directory)
+
+    if entry is not None and entry["stamp"] == stamp:
+        return entry["digest"]
+
+    sha = hashlib.sha256()
+
+    for name, _, _ in stamp:
+        sha.update(name.encode() + b"\0")
+
+        with open(os.path.join(compiler_directory, name), "rb") as file:
+            sha.update(hashlib.sha256(file.read()).digest())
+
+    digests[compiler_directory] = {"stamp": stamp, "digest": sha.hexdigest()}
+    write_file(digests_path, json.dumps(digests).encode())
+
+    return sha.hexdigest()
+
+def parse_arguments(arguments):
+    # Only a plain compile of one C file to one object is cached, anything else returns None.
+    if "-c" not in arguments or "-E" in arguments or arguments.count("-o") != 1:
+        return None
+
+    output_index = arguments.index("-o")
+
+    if output_index + 1 >= len(arguments):
+        return None
+
+    output = arguments[output_index + 1]
+    flags = arguments[:output_index] + arguments[output_index + 2:]
+    sources = [argument for argument in flags if argument.endswith(".c")]
+
+    if len(sources) != 1 or flags[-1] != sources[0]:
+        return None
+
+    return flags[:-1], sources[0], output
+
+def cache_key(cache_directory, compiler, flags, source):
+    preprocess_flags = [flag for flag in flags if flag != "-c"]
+    preprocessed = subprocess.run([compiler] + preprocess_flags + ["-E", source], stdout=subprocess.PIPE, stderr=subprocess.DEVNULL)
+
+    if preprocessed.returncode != 0:
+        return None
+
+    text = preprocessed.stdout
+
+    # asm-processor compiles a temporary copy of the source with a random name, which is only part of the debug information.
+    if os.path.dirname(os.path.abspath(source)) == os.path.abspath(tempfile.gettempdir()):
+        text = text.replace(source.encode(), b"<temporary>")
+
+    sha = hashlib.sha256()
+    sha.update(CACHE_VERSION + b"\0")
+    sha.update(compiler_digest(cache_directory, compiler).encode() + b"\0")
+    sha.update("\0".join(flags).encode() + b"\0\0")
+    sha.update(text)
+
+    return sha.hexdigest()
+
+def compile_cached(cache_directory, compiler, arguments):
+    parsed = parse_arguments(arguments)
+    key = None
+
+    if parsed is not None:
+        flags, source, output = parsed
+        key = cache_key(cache_directory, compiler, flags, source)
+
+    if key is None:
+        update_statistics(cache_directory, "uncacheable")
+        os.execv(compiler, [compiler] + arguments)
+
+    entry_path = os.path.join(cache_directory, key[:2], key)
+
+    # An entry is the length of the compiler's warnings, the warnings, and then the object.
+    try:
+        with open(entry_path, "rb") as file:
+            entry = file.read()
+    except OSError:
+        entry = None
+
+    if entry is not None:
+        (stderr_length,) = struct.unpack(">I", entry[:4])
+
+        write_file(output, entry[4 + stderr_length:])
+        sys.stderr.buffer.write(entry[4:4 + stderr_length])
+
+        update_statistics(cache_directory, "hits")
+        return 0
+
+    result = subprocess.run([compiler] + arguments, stderr=subprocess.PIPE)
+    sys.stderr.buffer.write(result.stderr)
+
+    update_statistics(cache_directory, "misses")
+
+    if result.returncode != 0:
+        return result.returncode
+
+    with open(output, "rb") as file:
+        object_data = file.read()
+
+    os.makedirs(os.path.dirname(entry_path), exist_ok=True)
+    write_file(entry_path, struct.pack(">I", len(result.stderr)) + result.stderr + object_data)
+
+    return 0
+
+def print_statistics(cache_directory):
+    try:
+        with open(os.path.join(cache_directory, "stats")) as file:
+            statistics = json.load(file)
+    except (OSError, ValueError):
+        statistics = {}
+
+    entries = 0
+    size = 0
+
+    for directory, _, names in os.walk(cache_directory):
+        if directory == cache_directory:
+            continue
+
+        for name in names:
+            if not name.endswith(".tmp"):
+                entries += 1
+                size += os.path.getsize(os.path.join(directory, name))
+
+    hits = statistics.get("hits", 0)
+    misses = statistics.get("misses", 0)
+
+    for name in STATISTICS:
+        print(f"{name:<12} {statistics.get(name, 0)}")
+
+    print(f"{'hit rate':<12} {100 * hits / (hits + misses) if hits + misses else 0:.1f}%")
+    print(f"{'entries':<12} {entries}")
+    print(f"{'size':<12} {size / (1024 * 1024):.1f} MiB")
+
+def main():
+    if sys.argv[1] == "--stats":
+        print_statistics(sys.argv[2])
+        return 0
+
+    if sys.argv[1] == "--zero-stats":
+        os.makedirs(sys.argv[2], exist_ok=True)
+        write_file(os.path.join(sys.argv[2], "stats"), b"{}")
+        return 0
+
+    cache_directory = sys.argv[1]
+    os.makedirs(cache_directory, exist_ok=True)
+
+    return compile_cached(cache_directory, sys.argv[2], sys.argv[3:])
+
+if __name__ == '__main__':
+    sys.exit(main())
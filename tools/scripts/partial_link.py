@@ -0,0 +1,260 @@
+# Splits the final link into one relocatable link (ld -r) per overlay segment and a link that only places the results,
+# so changing an overlay only links that overlay again before the final link.
+#   partial_link.py <config yaml> <linker script> <build directory> <makefile>
+# For every segment of the config with "overlay: yes", the objects the linker script puts into the segment's output
+# sections are combined by <build directory>/overlays/<segment>.ld. <build directory>/<linker script> is the linker script
+# with those objects replaced by <build directory>/overlays/<segment>.o, and the makefile lists what each of them depends on.
+import os
+import re
+import sys
+
+import yaml
+
+# An output section, like ".file_11 0x801CB460 : AT(file_11_ROM_START) SUBALIGN(16)" or ".file_11.bss (NOLOAD) : SUBALIGN(16)".
+OUTPUT_SECTION = re.compile(r"^\s*\.([A-Za-z_][\w.]*)[^=]*:")
+SUBALIGN = re.compile(r"SUBALIGN\((\w+)\)")
+FILL = re.compile(r"^\s*FILL\((\w+)\);")
+
+# An object's input section, like "build/us/asm/us/file_11/587370.s.o(.text);".
+INPUT_SECTION = re.compile(r"^(\s*)(\S+\.o)\(([^()\s]+)\);\s*$")
+
+def write_changed(path, data):
+    # Unchanged files keep their modification time, so only overlays that actually changed are linked again.
+    try:
+        with open(path) as file:
+            if file.read() == data:
+                return
+    except OSError:
+        pass
+
+    with open(path + ".tmp", "w") as file:
+        file.write(data)
+
+    os.replace(path + ".tmp", path)
+
+def overlay_segments(config_path):
+    # The C loader is a lot faster on a config this size, when PyYAML was built with it.
+    with open(config_path) as file:
+        config = yaml.load(file, Loader=getattr(yaml, "CSafeLoader", yaml.SafeLoader))
+
+    return {segment["name"] for segment in config["segments"] if isinstance(segment, dict) and segment.get("overlay")}
+
+def segment_of(output_section, segments):
+    # The segment is the output section's name, or the start of it up to a "." or "_", like file_11 for .file_11.bss.
+    name = output_section
+
+    while name not in segments:
+        cut = max(name.rfind("."), name.rfind("_"))
+
+        if cut <= 0:
+            return None
+
+        name = name[:cut]
+
+    return name
+
+class Run:
+    # Input sections of the same name from consecutive lines of an overlay's output section, placed as one input section.
+    def __init__(self, segment, output_section, subalign, fill, input_section):
+        self.segment = segment
+        self.output_section = output_section
+        self.subalign = subalign
+        self.fill = fill
+        self.input_section = input_section
+        self.indentation = ""
+        self.lines = []
+        self.objects = []
+        self.name = None
+
+def read_linker_script(lines, segments):
+    # Returns the lines of the linker script with every run replaced by its Run.
+    items = []
+    depth = 0
+    header = None
+    subalign = None
+    fill = None
+    segment = None
+    output_section = None
+    run = None
+
+    for line in lines:
+        match = INPUT_SECTION.match(line)
+
+        if match is not None and segment is not None:
+            indentation, path, input_section = match.groups()
+
+            if run is None or run.input_section != input_section:
+                run = Run(segment, output_section, subalign, fill, input_section)
+                run.indentation = indentation
+                items.append(run)
+
+            run.lines.append(line)
+            run.objects.append(path)
+            continue
+
+        run = None
+        items.append(line)
+
+        if depth == 1 and (header_match := OUTPUT_SECTION.match(line)) is not None:
+            header = header_match.group(1)
+            subalign_match = SUBALIGN.search(line)
+            subalign = subalign_match.group(1) if subalign_match is not None else None
+            fill = None
+        elif (fill_match := FILL.match(line)) is not None:
+            fill = fill_match.group(1)
+
+        depth += line.count("{") - line.count("}")
+
+        if depth == 2 and header is not None:
+            segment = segment_of(header, segments)
+            output_section = header
+            header = None
+        elif depth < 2:
+            segment = None
+
+    return items
+
+def main():
+    config_path, linker_script_path, build_directory, makefile_path = sys.argv[1:5]
+
+    segments = overlay_segments(config_path)
+
+    with open(linker_script_path) as file:
+        items = read_linker_script(file.readlines(), segments)
+
+    runs = [item for item in items if isinstance(item, Run)]
+    other_objects = set(re.findall(r"(\S+\.o)\s*\(", "".join(item for item in items if not isinstance(item, Run))))
+
+    # Overlays that stay as they are in the final link, with the reason for the first thing that rules them out.
+    excluded = {}
+
+    # An object that would also be linked on its own, or into more than one overlay, would be linked twice.
+    object_segments = {}
+
+    for run in runs:
+        for path in run.objects:
+            object_segments.setdefault(path, set()).add(run.segment)
+
+    for path, owners in object_segments.items():
+        if len(owners) > 1:
+            for segment in owners:
+                excluded.setdefault(segment, f"{path} is also in {', '.join(sorted(owners - {segment}))}")
+        elif path in other_objects:
+            for segment in owners:
+                excluded.setdefault(segment, f"{path} is also linked outside of the overlay")
+
+    # The objects of a run only keep their offsets from each other when the final link aligns the combined section like it
+    # aligned the first of them. SUBALIGN gives every one of them, and so the combined section, the same alignment.
+    for run in runs:
+        if run.subalign is None:
+            excluded.setdefault(run.segment, f".{run.output_section} has no SUBALIGN")
+
+    # Common symbols stay common in ld -r, and are placed by the final link wherever the combined object's COMMON is,
+    # which is only the same place when all of them were in one run.
+    common_runs = {}
+
+    for run in runs:
+        if run.input_section == "COMMON":
+            common_runs[run.segment] = common_runs.get(run.segment, 0) + 1
+
+    for segment, count in common_runs.items():
+        if count > 1:
+            excluded.setdefault(segment, "its COMMON symbols are placed in more than one spot")
+
+    for segment, reason in sorted(excluded.items()):
+        print(f"partial_link.py: {segment} isn't linked on its own, {reason}.")
+
+    overlays = {}
+
+    for run in runs:
+        if run.segment not in excluded:
+            overlays.setdefault(run.segment, []).append(run)
+
+    overlay_directory = os.path.join(build_directory, "overlays")
+    os.makedirs(overlay_directory, exist_ok=True)
+
+    for segment, segment_runs in overlays.items():
+        # Runs are named after the segment and their input section, numbered when an overlay has more than one of the same
+        # name. Sections the linker script doesn't mention, like the empty .data and .bss of every assembled file, keep
+        # their own names instead of being added to a run, so the final link treats them like before.
+        counts = {}
+
+        for run in segment_runs:
+            counts[run.input_section] = counts.get(run.input_section, 0) + 1
+
+        numbers = {}
+
+        for run in segment_runs:
+            if run.input_section == "COMMON":
+                run.name = "COMMON"
+                continue
+
+            name = f".{segment}." + re.sub(r"[^\w.]", "", run.input_section).lstrip(".")
+
+            if counts[run.input_section] > 1:
+                numbers[run.input_section] = numbers.get(run.input_section, 0) + 1
+                name += f".{numbers[run.input_section]}"
+
+            run.name = name
+
+        script = "/* Written by tools/scripts/partial_link.py, don't edit. */\n\n"
+        script += "INPUT(\n" + "".join(f"    {path}\n" for path in dict.fromkeys(path for run in segment_runs for path in run.objects)) + ")\n\n"
+        script += "SECTIONS\n{\n"
+
+        for run in segment_runs:
+            if run.input_section == "COMMON":
+                continue
+
+            # Every section starts at 0 like in an object from the assembler or compiler, otherwise the subalign padding
+            # would depend on where the sections before it ended.
+            subalign = f" SUBALIGN({run.subalign})" if run.subalign is not None else ""
+            # The padding between the objects is filled like the output section they came from would have. Not with FILL,
+            # which would keep sections none of the objects have, and those would still be aligned in the final link.
+            fill = f" ={run.fill}" if run.fill is not None else ""
+            script += f"    {run.name} 0 :{subalign}\n    {{\n" + "".join(f"        {path}({run.input_section});\n" for path in run.objects) + f"    }}{fill}\n"
+
+        script += "}\n"
+
+        write_changed(os.path.join(overlay_directory, f"{segment}.ld"), script)
+
+    final_script = ""
+
+    for item in items:
+        if not isinstance(item, Run):
+            final_script += item
+        elif item.segment in excluded:
+            final_script += "".join(item.lines)
+        else:
+            final_script += f"{item.indentation}{overlay_directory}/{item.segment}.o({item.name});\n"
+
+    final_script_path = os.path.join(build_directory, os.path.basename(linker_script_path))
+    write_changed(final_script_path, final_script)
+
+    generated = [final_script_path] + [os.path.join(overlay_directory, f"{segment}.ld") for segment in overlays]
+
+    # Always written, so it's never older than the scripts it depends on.
+    with open(makefile_path + ".tmp", "w") as output:
+        output.write("# Written by tools/scripts/partial_link.py, don't edit.\n\n")
+        output.write("OVERLAY_O_FILES :=")
+
+        for segment in overlays:
+            output.write(f" \\\n    {overlay_directory}/{segment}.o")
+
+        output.write("\n")
+
+        for segment, segment_runs in overlays.items():
+            output.write(f"\n{overlay_directory}/{segment}.o:")
+
+            for path in dict.fromkeys(path for run in segment_runs for path in run.objects):
+                output.write(f" \\\n    {path}")
+
+            output.write("\n")
+
+        # Like the file list, a generated script that was deleted makes this be written again instead of failing.
+        output.write(f"\n{makefile_path}: {' '.join(generated)}\n")
+        output.write(f"\n{' '.join(generated)}: ;\n")
+
+    os.replace(makefile_path + ".tmp", makefile_path)
+
+if __name__ == '__main__':
+    main()